@@ -34,7 +34,6 @@
 #endif
 #define TIMEOUT                20     // number of wrong / missing input commands before emergency off
 #define A2BIT_CONV             50     // A to bit for current conversion on ADC. Example: 1 A = 50, 2 A = 100, etc
-// #define PRINTF_FLOAT_SUPPORT          // [-] Uncomment this for printf to support float on Serial Debug. It will increase code size! Better to avoid it!
 
 // ADC conversion time definitions
 #define ADC_CONV_TIME_1C5       (14)  //Total ADC clock cycles / conversion = (  1.5+12.5)
@@ -98,6 +97,8 @@
 * Получите реальную температуру чипа от Thermo Cam или еще одного температуру, записанного на верхнюю часть чипа, и напишите его в TEMP_CAL_LOW_DEG_C.
 * Напишите выходное значение отладки 8 в TEMP_CAL_LOW_ADC.Поезжайте, чтобы согреть доску.Это должно быть не менее 20 ° C теплее.Повторите его для больших значений.
 * Включите предупреждение и/или Poweroff, а также создайте и вспыхивают прошивку.
+* Снижение тока: между TEMP_DERATE_START и TEMP_DERATE_END i_max (и n_max с TEMP_DERATE_SPEED) линейно уменьшается до TEMP_DERATE_MIN.
+* Плата продолжает ехать медленнее вместо отключения. Коэффициент виден в протоколе отладки (TEMP_DER_FAC) и в обратной связи (tempDerate).
 */
 #define TEMP_FILT_COEF          655       // Коэффициент температурного фильтра в фиксированной точке.coef_fixedpoint = coef_floatingPoint * 2^16.В этом случае 655 = 0,01 * 2^16
 #define TEMP_CAL_LOW_ADC        1655      // Температура 1: значение АЦП
@@ -108,6 +109,11 @@
 #define TEMP_WARNING            600       // раздражающий быстрый звуковой сигнал [° C * 10].Здесь 60,0 ° C.
 #define TEMP_POWEROFF_ENABLE    0         // Для Poweroff или не для Poweroff, 1 или 0, не активируйте без калибровки!
 #define TEMP_POWEROFF           650       // перегрев мощность.(в то время как не ездит) [° C * 10].Здесь 65,0 ° C.
+#define TEMP_DERATE_ENABLE      0         // Для снижения тока при перегреве или нет, 1 или 0, не активируйте без калибровки!
+#define TEMP_DERATE_START       500       // начало снижения i_max [° C * 10].Здесь 50,0 ° C.
+#define TEMP_DERATE_END         600       // конец снижения, i_max равен TEMP_DERATE_MIN [° C * 10].Здесь 60,0 ° C.
+#define TEMP_DERATE_MIN         30        // [%] оставшийся ток при TEMP_DERATE_END
+#define TEMP_DERATE_SPEED       0         // Снижать также n_max в том же отношении, 1 или 0
 // ######################## Конец температуры ###############################
 
 
@@ -141,6 +147,7 @@
 #define VLT_MODE        1               // [-] VOLTAGE mode
 #define SPD_MODE        2               // [-] SPEED mode
 #define TRQ_MODE        3               // [-] TORQUE mode
+#define POS_MODE        4               // [-] POSITION mode. Runs the motors in SPEED mode, see POSITION_CONTROL
 
 // Enable/Disable Motor
 #define MOTOR_LEFT_ENA                  // [-] Enable LEFT motor.  Comment-out if this motor is not needed to be operational
@@ -163,8 +170,40 @@
 #define FIELD_WEAK_HI   1000            // (1000, 1500] Input target High threshold for reaching maximum Field Weakening / Phase Advance. Do NOT set this higher than 1500.
 #define FIELD_WEAK_LO   750             // ( 500, 1000] Input target Low threshold for starting Field Weakening / Phase Advance. Do NOT set this higher than 1000.
 
+// Speed loop gain schedule (only for SPEED mode)
+/* The speed PI gains (cf_nKp, cf_nKi) are interpolated over the absolute measured speed of each motor, between 3 breakpoints.
+ * Outside the breakpoints the first or last gains are kept. Evaluated in the main loop. The table can be changed and saved
+ * to EEPROM with the debug protocol (GS_N1..3, GS_KP1..3, GS_KI1..3).
+ * cf_nKp is in fixdt(0,16,12) and cf_nKi in fixdt(0,16,16). The default controller gains are cf_nKp = 4833, cf_nKi = 251.
+*/
+// #define GAIN_SCHED_ENABLE               // [-] Enable the speed loop gain schedule
+#define GAIN_SCHED_N1   0               // [rpm] Breakpoint 1: standstill, where the hall speed is coarse
+#define GAIN_SCHED_N2   100             // [rpm] Breakpoint 2
+#define GAIN_SCHED_N3   400             // [rpm] Breakpoint 3
+#define GAIN_SCHED_KP1  3000            // [-] cf_nKp at breakpoint 1
+#define GAIN_SCHED_KP2  4833            // [-] cf_nKp at breakpoint 2
+#define GAIN_SCHED_KP3  6500            // [-] cf_nKp at breakpoint 3
+#define GAIN_SCHED_KI1  150             // [-] cf_nKi at breakpoint 1
+#define GAIN_SCHED_KI2  251             // [-] cf_nKi at breakpoint 2
+#define GAIN_SCHED_KI3  350             // [-] cf_nKi at breakpoint 3
+
+// Steering authority schedule
+/* The steering command in the mixer is scaled by a factor interpolated over the average absolute wheel speed (speedAvgAbs),
+ * between 3 breakpoints, before the left/right saturation. Outside the breakpoints the first or last factor is kept.
+ * This gives full steering when maneuvering and a calmer, more stable steering at speed. The table can be changed and saved
+ * to EEPROM with the debug protocol (SS_N1..3, SS_R1..3).
+ * The factors are in fixdt(0,16,14): 16384 = 1.0 = STEER_COEFFICIENT unchanged.
+*/
+// #define STEER_SCHED_ENABLE              // [-] Enable the speed-dependent steering authority
+#define STEER_SCHED_N1  50              // [rpm] Breakpoint 1
+#define STEER_SCHED_N2  200             // [rpm] Breakpoint 2
+#define STEER_SCHED_N3  500             // [rpm] Breakpoint 3
+#define STEER_SCHED_R1  16384           // [-] Steering factor at breakpoint 1 (1.0)
+#define STEER_SCHED_R2  11469           // [-] Steering factor at breakpoint 2 (0.7)
+#define STEER_SCHED_R3  6554            // [-] Steering factor at breakpoint 3 (0.4)
+
 // Extra functionality
-// #define STANDSTILL_HOLD_ENABLE          // [-] Flag to hold the position when standtill is reached. Only available and makes sense for VOLTAGE or TORQUE mode.
+// #define STANDSTILL_HOLD_ENABLE          // [-] Flag to hold the position when standtill is reached. Only available and makes sense for VOLTAGE or TORQUE mode. See HILL HOLD for the position-locked hold.
 // #define ELECTRIC_BRAKE_ENABLE           // [-] Flag to enable electric brake and replace the motor "freewheel" with a constant braking when the input torque request is 0. Only available and makes sense for TORQUE mode.
 // #define ELECTRIC_BRAKE_MAX    100       // (0, 500) Maximum electric brake to be applied when input torque request is 0 (pedal fully released).
 // #define ELECTRIC_BRAKE_THRES  120       // (0, 500) Threshold below at which the electric brake starts engaging.
@@ -172,6 +211,270 @@
 
 
 
+// ############################### ENCODER ###############################
+/* Quadrature encoder for the measured angle path (a_mechAngle) instead of the 60 deg hall sectors:
+ * 1. Encoder A/B signals are decoded by a timer in encoder mode (x4). The counter wraps once per mechanical revolution (ENCODER_CPR)
+ * 2. Alignment is hall based: on the first hall transition the encoder count is matched to the hall sector boundary
+ *    and then the measured angle is enabled (b_angleMeasEna) for that motor. Until then the hall estimation is used.
+ * 3. A deviation above ENCODER_ALIGN_TOL on a later hall transition (e.g. wrong ENCODER_CPR, inverted direction or lost counts)
+ *    falls back to the hall estimation and the alignment is repeated.
+ *
+ * Pins:
+ * LEFT:  TIM2 partial remap. A -> PA15, B -> PB3. These are JTAG pins, SWD stays usable. TIM2 is also used by PPM/PWM control!
+ * RIGHT: the stock board has no free encoder capable timer pins. For a custom wiring define RIGHT_ENC_TIM, RIGHT_ENC_TIM_CLK_ENABLE(),
+ *        RIGHT_ENC_A_PIN/PORT, RIGHT_ENC_B_PIN/PORT and optionally RIGHT_ENC_REMAP() (see defines.h)
+*/
+// #define ENCODER_LEFT                   // [-] Enable LEFT motor encoder
+// #define ENCODER_RIGHT                  // [-] Enable RIGHT motor encoder (needs custom pins, see above)
+#define ENCODER_CPR         4096          // [-] Encoder counts per mechanical revolution (4 x encoder lines). Maximum 65536
+#define ENCODER_LEFT_POL    TIM_ICPOLARITY_RISING   // [-] LEFT encoder counting direction. Use TIM_ICPOLARITY_FALLING to invert
+#define ENCODER_RIGHT_POL   TIM_ICPOLARITY_RISING   // [-] RIGHT encoder counting direction. Use TIM_ICPOLARITY_FALLING to invert
+#define ENCODER_ALIGN_TOL   480           // [deg] Electrical angle tolerance on hall transitions in fixdt(1,16,4). In this case 480 = 30 * 2^4
+// ######################## END OF ENCODER ###############################
+
+
+
+// ########################### HALL CALIBRATION ############################
+/* Automatic hall order and offset calibration. Start it with the debug command "HALLCAL" (DEBUG_SERIAL_PROTOCOL), wheels lifted:
+ * 1. For each enabled motor an open loop voltage vector (HALL_CALIB_VOLT) is rotated slowly through HALL_CALIB_REVS electrical
+ *    revolutions forward and then backward. The controllers are disabled meanwhile.
+ * 2. The hall states are recorded per electrical angle. The center of each state gives the hall sector, from which the mapping
+ *    raw hall state -> controller hall state is built (wiring order and direction) and the mean angle offset of the hall transitions.
+ * 3. The result is saved per motor in EEPROM and applied at startup by remapping the hall inputs.
+ *    The offset is reported and used for the encoder alignment (ENCODER_LEFT/ENCODER_RIGHT). The hall estimation keeps its fixed sectors.
+ * A calibration fails if a hall state was not seen or two states fall in the same sector (check the hall wiring and HALL_CALIB_VOLT).
+*/
+// #define HALL_CALIB_ENABLE              // [-] Enable the hall calibration command
+#define HALL_CALIB_VOLT     80            // [-] Voltage vector amplitude in duty [0, 1000]. Increase if the rotor does not follow, decrease if the motor gets hot
+#define HALL_CALIB_STEP_MS  5             // [ms] Time per 2 deg electrical step. In this case 5 ms -> 0.9 s per electrical revolution
+#define HALL_CALIB_REVS     2             // [-] Number of electrical revolutions per direction
+#define HALL_CALIB_KEY      0xA5          // [-] Marker of a saved hall calibration [0, 255]. Change it to ignore the calibrations in the flash memory
+// ###################### END OF HALL CALIBRATION ##########################
+
+
+
+// ######################### RIPPLE COMPENSATION ###########################
+/* Torque ripple and cogging compensation, indexed by the electrical angle a_elecAngle in [deg] (per motor):
+ * 1. In TRQ_MODE the table value at the current angle (linearly interpolated) is added to the torque target, which is the
+ *    q-current reference of the FOC (1000 = i_max). Scale it with "SET RIP_GAIN" in [%], 0 = off.
+ * 2. Learning with the debug command "RIPLEARN" (wheels lifted): both motors run in SPD_MODE at RIPPLE_LEARN_SPD, first forward
+ *    then backward, for RIPPLE_LEARN_TIME each. The measured iq (the speed loop effort) is averaged per angle bin and its
+ *    mean is removed. The result is the current the speed loop had to add at that angle, it is saved in EEPROM.
+ * The SPD_MODE and VLT_MODE are not compensated: the speed loop output is internal to the motor controller.
+*/
+// #define RIPPLE_COMP_ENABLE             // [-] Enable the ripple compensation table and the learning command
+#define RIPPLE_COMP_BINS    36            // [-] Table points per electrical revolution. Maximum 36 (EEPROM layout), has to be even
+#define RIPPLE_COMP_GAIN    100           // [%] Default compensation gain [0, 200]
+#define RIPPLE_LEARN_SPD    30            // [rpm] Learning speed. Low enough for a good angle resolution, high enough for a smooth rotation
+#define RIPPLE_LEARN_TIME   10000         // [ms] Learning time per direction
+#define RIPPLE_COMP_KEY     0xA6          // [-] Marker of a saved compensation table. Change it to ignore the tables in the flash memory
+// ###################### END OF RIPPLE COMPENSATION #######################
+
+
+
+// ########################### POSITION CONTROL ############################
+/* Position control as an outer loop on top of the FOC SPEED mode (select CTRL_MOD_REQ = POS_MODE or "SET CTRL_MOD 4"):
+ * 1. Each wheel position is counted in 32-bit in the ISR: +/-1 per hall sector (6 x pole pairs per revolution)
+ *    or, when ENCODER_LEFT/ENCODER_RIGHT is used, +/-1 per encoder count (ENCODER_CPR per revolution).
+ * 2. At 1 kHz the position error is multiplied by POS_KP and limited to the maximum speed command. This replaces the
+ *    input target (pwml/pwmr), the inner speed and current loops stay in the motor controller.
+ * 3. Positions and targets are in the motor frame, like speedL_meas/speedR_meas in the serial feedback.
+ *
+ * Targets are sent with CONTROL_SERIAL_USART2/3 as a separate frame, next to the normal command frame:
+ *   start = SERIAL_POS_START_FRAME, mode = 0: absolute, 1: relative to the current target,
+ *   posL, posR (int32), spdMax = maximum speed command [0, 1000] (0 = POS_SPD_MAX), checksum = XOR of all 16-bit words
+ * The position frame is applied once. Keep sending the normal command frame to avoid the serial timeout.
+ * On timeout or when the motors are disabled, the target follows the measured position (no jump when re-enabled).
+*/
+// #define POSITION_CONTROL               // [-] Enable position control mode (POS_MODE). Only available for FOC_CTRL
+#define SERIAL_POS_START_FRAME  0xABCE    // [-] Start frame definition for the position target frame
+#define POS_KP              2560          // [-] Position gain in fixdt(0,16,8) [speed command / count]. In this case 2560 = 10 * 2^8. Use lower values for encoders
+#define POS_SPD_MAX         300           // [-] Default maximum speed command [0, 1000]. 1000 corresponds to N_MOT_MAX
+#define POS_DBAND           1             // [-] Position deadband [counts]. Inside the deadband the speed command is 0 and the target is reported reached
+// ######################## END OF POSITION CONTROL ########################
+
+
+
+// ######################### TRAJECTORY GENERATOR ##########################
+/* Jerk limited (S-curve) shaping of the motor targets pwml/pwmr, and of the speed command in POS_MODE:
+ * 1. Each wheel target is stepped in the DMA ISR at a fixed 1 kHz, independent of the main loop timing.
+ * 2. The slope (acceleration) ramps with SCURVE_JERK_MAX up to SCURVE_ACC_MAX and is ramped down before the target is reached.
+ * 3. When enabled it replaces the RATE limiter and the FILTER low-pass of the main loop.
+ * The limits are shared by both wheels and can be changed at runtime in the debug protocol (SC_VEL_MAX, SC_ACC_MAX, SC_JERK_MAX).
+*/
+// #define SCURVE_ENABLE                  // [-] Enable the S-curve trajectory generator
+#define SCURVE_VEL_MAX      1000          // [-] Maximum target [0, 1000]
+#define SCURVE_ACC_MAX      4000          // [-/s] Maximum target slope (0, 32767]. In this case 0 to 1000 takes 0.25 s plus the jerk ramps
+#define SCURVE_JERK_MAX     20000         // [-/s^2] Maximum change of the slope (0, 32767]. In this case 0 to SCURVE_ACC_MAX takes 0.2 s
+// ###################### END OF TRAJECTORY GENERATOR ######################
+
+
+
+// ############################ COMMAND FILTER #############################
+/* Second-order (biquad) shaping of the speed and steer commands in the main loop, instead of the first-order FILTER low-pass:
+ * 1. The RATE limiter stays in front of the filter. Each channel has its own filter type, frequency and Q.
+ * 2. Low-pass: steeper roll-off with less lag than FILTER at the same smoothing. Q <= 0.5 (128) is critically damped, no overshoot.
+ *    Higher Q overshoots the command, e.g. Q = 0.707 (181, Butterworth) by about 4% on a step.
+ * 3. Notch: removes a narrow band around the chassis resonance and passes the rest of the command unchanged.
+ * The coefficients are derived from the frequency and Q at startup and recomputed when they are changed at runtime in the
+ * debug protocol (BQ_SPD_TYP, BQ_SPD_FC, BQ_SPD_Q, BQ_STR_TYP, BQ_STR_FC, BQ_STR_Q).
+ * The frequency has to stay below the Nyquist frequency of the main loop: 500 / DELAY_IN_MAIN_LOOP [Hz].
+*/
+// #define BIQUAD_ENABLE                  // [-] Enable the biquad command filter
+#define BIQUAD_SPD_TYP      0             // [-] Speed filter type: 0 = low-pass, 1 = notch
+#define BIQUAD_SPD_FC       30            // [Hz*10] Speed cutoff / notch frequency. In this case 3.0 Hz
+#define BIQUAD_SPD_Q        128           // [-] Speed filter Q, fixdt(0,16,8). In this case 0.5 = 128 / 2^8
+#define BIQUAD_STR_TYP      0             // [-] Steer filter type: 0 = low-pass, 1 = notch
+#define BIQUAD_STR_FC       50            // [Hz*10] Steer cutoff / notch frequency. In this case 5.0 Hz
+#define BIQUAD_STR_Q        128           // [-] Steer filter Q, fixdt(0,16,8)
+// ######################### END OF COMMAND FILTER #########################
+
+
+
+// ######################### WHEEL SYNCHRONISATION #########################
+/* Cross-coupled synchronisation of the left and right wheel in SPEED mode, for straight-line tracking with unequal loads:
+ * 1. At 1 kHz the measured speeds n_mot are compared against the ratio of the wheel targets (after the mixer and S-curve).
+ *    The deviation orthogonal to the commanded ratio (the sync error) is split on both wheels with opposite sign.
+ * 2. A PI controller (SYNC_KP, SYNC_KI) corrects both targets, limited to +/- SYNC_CORR_MAX. The common speed is not changed.
+ * 3. Below SYNC_TGT_MIN (e.g. standstill) and outside SPD_MODE the correction and the integrators are reset.
+ * The gains and the limit can be changed at runtime in the debug protocol (SYNC_KP, SYNC_KI, SYNC_CORR_MAX).
+*/
+// #define SYNC_CTRL_ENABLE               // [-] Enable the left/right wheel synchronisation
+#define SYNC_KP             128           // [-] Proportional gain in fixdt(0,16,8). In this case 128 = 0.5 * 2^8
+#define SYNC_KI             655           // [-] Integral gain per 1 ms step in fixdt(0,16,16). In this case 655 = 0.01 * 2^16
+#define SYNC_CORR_MAX       100           // [-] Maximum correction per wheel [0, 1000]
+#define SYNC_TGT_MIN        20            // [-] Minimum target (|left| + |right|) to activate the synchronisation
+// ###################### END OF WHEEL SYNCHRONISATION #####################
+
+
+
+// ########################### TRACTION CONTROL ############################
+/* Wheel slip detection and traction control in TORQUE mode (e.g. HOVERCAR, SKATEBOARD on wet floors):
+ * 1. At 1 kHz the wheel acceleration is derived from n_mot (filtered with TRC_FILT).
+ * 2. A wheel is slipping when it accelerates in the torque direction faster than plausible for the torque target
+ *    (TRC_ACC_MAX at target 1000, at least 10% of it) or when it is faster than the other wheel by more than TRC_DN_MAX.
+ * 3. While slipping, the torque factor drops by TRC_DEC per 1 ms step, afterwards it ramps back by TRC_INC per step.
+ * The limits can be changed at runtime in the debug protocol (TRC_ACC_MAX, TRC_DN_MAX, TRC_DEC, TRC_INC).
+*/
+// #define TRACTION_CTRL                  // [-] Enable traction control in TRQ_MODE
+#define TRC_ACC_MAX         3000          // [rpm/s] Plausible wheel acceleration at torque target 1000
+#define TRC_DN_MAX          150           // [rpm] Plausible speed difference to the other wheel (cornering)
+#define TRC_DEC             3277          // [-] Torque factor decrease per 1 ms step in fixdt(0,16,15). In this case 3277 = 0.1 * 2^15 -> 10 ms to zero torque
+#define TRC_INC             164           // [-] Torque factor recovery per 1 ms step in fixdt(0,16,15). In this case 164 = 0.005 * 2^15 -> 200 ms to full torque
+#define TRC_FILT            6553          // [-] Acceleration filter in fixdt(0,16,16). In this case 6553 = 0.1 * 2^16
+// ######################## END OF TRACTION CONTROL ########################
+
+
+
+// ########################### ANTI-LOCK BRAKE #############################
+/* Brake torque modulation against wheel lock (e.g. SKATEBOARD, HOVERCAR braking hard on smooth floors):
+ * 1. At 1 kHz the wheel deceleration is derived from n_mot (filtered with ABS_FILT).
+ * 2. Braking is decided against the vehicle speed (average of both wheels), so a locked wheel at standstill is still modulated.
+ *    While braking, a wheel is locking when it decelerates faster than ABS_DEC_MAX or when it is slower than the other wheel
+ *    by more than ABS_DN_MAX. Below ABS_N_MIN (both wheels) the brake is not modulated, so the vehicle can stop.
+ * 3. While locking, the brake factor drops by ABS_DEC per 1 ms step, afterwards it ramps back by ABS_INC per step.
+ *    Only the braking part of the target is reduced: TRQ_MODE scales the braking torque, SPD_MODE moves the decelerating speed
+ *    target towards the vehicle speed. VLT_MODE is not modulated.
+ * The thresholds can be changed at runtime in the debug protocol (ABS_DEC_MAX, ABS_DN_MAX).
+*/
+// #define ABS_BRAKE_ENABLE               // [-] Enable the anti-lock brake modulation in TRQ_MODE and SPD_MODE
+#define ABS_DEC_MAX         2000          // [rpm/s] Plausible wheel deceleration while braking
+#define ABS_DN_MAX          100           // [rpm] Plausible speed difference to the other wheel while braking (cornering)
+#define ABS_N_MIN           30            // [rpm] No modulation when both wheels are slower
+#define ABS_DEC             6554          // [-] Brake factor decrease per 1 ms step in fixdt(0,16,15). In this case 6554 = 0.2 * 2^15 -> 5 ms to zero brake
+#define ABS_INC             328           // [-] Brake factor recovery per 1 ms step in fixdt(0,16,15). In this case 328 = 0.01 * 2^15 -> 100 ms to full brake
+#define ABS_FILT            13107         // [-] Deceleration filter in fixdt(0,16,16). In this case 13107 = 0.2 * 2^16
+// ####################### END OF ANTI-LOCK BRAKE #########################
+
+
+
+// ############################# REGEN LIMITS ##############################
+/* Separate limits for the regenerative (charging) direction, e.g. to protect the BMS with a full battery:
+ * 1. The DC link current of both motors is averaged per 1 ms. The regen current (into the battery) is limited to REGEN_I_MAX
+ *    by an integrating foldback factor. It reduces only the braking part of the targets.
+ * 2. Above REGEN_V_START the battery voltage folds the regen factor back linearly. At REGEN_V_STOP the motors coast.
+ * 3. TRQ_MODE: a braking torque target (opposite to the rotation) is scaled by the factor.
+ *    SPD_MODE: a decelerating speed target is moved towards the measured speed, which limits the braking torque of the speed loop.
+ * REGEN_I_MAX can be changed at runtime in the debug protocol (REGEN_I_MAX), the factor is visible as REGEN_FAC.
+*/
+// #define REGEN_LIMIT_ENABLE             // [-] Enable the regen current and overvoltage foldback
+#define REGEN_I_MAX         5             // [A] Maximum regen DC current of both motors together
+#define REGEN_V_START       (415 * BAT_CELLS * BAT_CALIB_ADC) / BAT_CALIB_REAL_VOLTAGE    // [-] Start of the voltage foldback in batVoltage (ADC) scaling. In this case 4.15 V/cell
+#define REGEN_V_STOP        (425 * BAT_CELLS * BAT_CALIB_ADC) / BAT_CALIB_REAL_VOLTAGE    // [-] No regeneration above this voltage in batVoltage (ADC) scaling. In this case 4.25 V/cell
+// ########################## END OF REGEN LIMITS ##########################
+
+
+
+// ######################### BATTERY CURRENT LIMIT #########################
+/* Limit of the total battery (discharge) current of both motors, e.g. for a BMS with a continuous current limit:
+ * 1. The DC link current of both motors is averaged per 1 ms (same measurement as REGEN_LIMIT_ENABLE).
+ * 2. BAT_I_PEAK is allowed for about BAT_T_PEAK. While the current is above BAT_I_CONT the limit goes down linearly to BAT_I_CONT,
+ *    below BAT_I_CONT it recovers in the same way.
+ * 3. The limit factor reduces the driving part of both wheel targets proportionally: TRQ_MODE scales the torque target,
+ *    SPD_MODE moves an accelerating target towards the measured speed. At low speed the battery current is low, full phase current stays available.
+ * The limits can be changed at runtime in the debug protocol (BAT_I_CONT, BAT_I_PEAK, BAT_T_PEAK).
+*/
+// #define BAT_LIMIT_ENABLE               // [-] Enable the battery current limit
+#define BAT_I_CONT          20            // [A] Continuous battery current of both motors together
+#define BAT_I_PEAK          30            // [A] Peak battery current
+#define BAT_T_PEAK          5000          // [ms] Time at BAT_I_PEAK until the limit is back at BAT_I_CONT. Maximum 65535
+// ###################### END OF BATTERY CURRENT LIMIT #####################
+
+
+
+// ########################## MOTOR THERMAL MODEL ##########################
+/* First order thermal model of each motor winding, e.g. to allow a high I_MOT_MAX for short peaks:
+ * 1. The squared phase current (iq^2 + id^2) is averaged over 1 s. The heat state follows it with the time constant MOT_THERM_TAU.
+ *    The model is scaled such that MOT_THERM_I_CONT in steady state heats the winding up to MOT_THERM_T_MAX.
+ * 2. Between MOT_THERM_T_START and MOT_THERM_T_MAX the current limit i_max is lowered linearly from I_MOT_MAX to MOT_THERM_I_CONT.
+ *    In the debug protocol I_MOT_MAX stays the nominal limit, the derated limit is only written to the controller.
+ * 3. The estimated winding temperature is visible in the debug protocol (MOT_TEMPL, MOT_TEMPR) and is appended to the serial feedback
+ *    (motTempL, motTempR before the checksum, the receiver has to use the same frame).
+ * The model starts at MOT_THERM_T_AMB after power on, it does not know how hot the motors still are from a previous ride.
+*/
+// #define MOT_THERM_ENABLE               // [-] Enable the motor thermal model and the current derating
+#define MOT_THERM_I_CONT    8             // [A] Continuous phase current of the motors
+#define MOT_THERM_TAU       300           // [s] Thermal time constant of the winding
+#define MOT_THERM_T_AMB     400           // [°C*10] Ambient temperature of the model. Here 40.0 °C
+#define MOT_THERM_T_START   900           // [°C*10] Winding temperature to start the derating. Here 90.0 °C
+#define MOT_THERM_T_MAX     1100          // [°C*10] Winding temperature with i_max at MOT_THERM_I_CONT. Here 110.0 °C
+// ####################### END OF MOTOR THERMAL MODEL ######################
+
+
+
+// ########################### BUMPLESS TRANSFER ###########################
+/* Bumpless transfer between control modes and control types at runtime (debug protocol, sideboard switches, drive modes):
+ * The controller already initializes the speed and torque loop with the last applied voltage. The remaining jolt comes from the target:
+ * the same input means voltage, speed or torque depending on the mode. At a transfer the target is therefore offset to the
+ * operating point in the new mode (last voltage, measured speed or measured iq). The offset decays linearly within BUMPLESS_TIME.
+ * Not applied when the motors are disabled or the mode is OPEN_MODE.
+*/
+// #define BUMPLESS_ENABLE                // [-] Enable the bumpless mode and type transfer
+#define BUMPLESS_TIME       500           // [ms] Time to remove the target offset after a transfer
+// ######################## END OF BUMPLESS TRANSFER #######################
+
+
+
+// ############################### HILL HOLD ###############################
+/* Position-locked hill hold. Replaces the STANDSTILL_HOLD_ENABLE cruise control hold, only for FOC TORQUE mode:
+ * Below HILL_HOLD_SPD and with no throttle the wheel positions (hall transitions, or encoder counts) are latched and a stiff
+ * position-to-torque loop (P on the position error, D on the measured speed) holds the wheels. On throttle the hold torque
+ * fades out within HILL_HOLD_RELEASE while the throttle torque takes over, so the cart does not roll back.
+ * The hold current is limited to HILL_HOLD_I_MAX. An I2t budget lowers the limit to HILL_HOLD_I_CONT after HILL_HOLD_T_MAX at
+ * HILL_HOLD_I_MAX (longer at a lower current) and recovers when the hold current is below HILL_HOLD_I_CONT.
+*/
+// #define HILL_HOLD_ENABLE               // [-] Enable the position-locked hill hold. Only for FOC TORQUE mode
+#define HILL_HOLD_SPD       5             // [rpm] Speed below which the hold is latched
+#define HILL_HOLD_KP        25600         // [-] Position gain in fixdt(0,16,8) [torque target / count]. 1000 torque target = I_MOT_MAX
+#define HILL_HOLD_KD        2560          // [-] Speed damping in fixdt(0,16,8) [torque target / rpm]
+#define HILL_HOLD_I_MAX     10            // [A] Maximum hold current
+#define HILL_HOLD_I_CONT    4             // [A] Hold current allowed continuously
+#define HILL_HOLD_T_MAX     10000         // [ms] Time at HILL_HOLD_I_MAX until the limit is lowered to HILL_HOLD_I_CONT
+#define HILL_HOLD_RELEASE   300           // [ms] Time to fade out the hold torque on throttle
+// ########################### END OF HILL HOLD ############################
+
+
+
 // ############################## DEFAULT SETTINGS ############################
 // Настройки по умолчанию будут применены в конце этого файла конфигура
 #define INACTIVITY_TIMEOUT        30       // Минут бездействия для отключения.
@@ -209,6 +512,14 @@
  * AUX_INPUT: Auxiliary Input. These limits will be used for the input with priority 1
  * -----------------------------------------
 */
+
+/* Input response curves (INPUT_CURVE_ENABLE), applied in calcInputCmd() before the rate limiter and filter:
+ * EXPO:      0 = linear, 100 = cubic. cmd = x * ((100 - EXPO) + EXPO * x^2) / 100, with x the scaled input in [-1, 1]
+ *            Higher values give finer control near 0 (smoother starts), the full command is still reached at the input maximum.
+*/
+// #define INPUT_CURVE_ENABLE                // Enable the input response curves. Adjustable and saved to EEprom via the debug protocol
+#define INPUT1_EXPO           0             // [%] Response curve of input1 (PRI and AUX) [0, 100]
+#define INPUT2_EXPO           0             // [%] Response curve of input2 (PRI and AUX) [0, 100]
  // ############################## END OF INPUT FORMAT ############################
 
 
@@ -219,10 +530,17 @@
  * can be activated/deactivated by pressing button1 (Blue cable) to GND
  * when activated, it maintains the current speed by switching to SPD_MODE. Acceleration is still possible via the input request, but when released it resumes to previous set speed.
  * when deactivated, it returns to previous control MODE and follows the input request.
+ * with CRUISE_PI_ENABLE the controller cruise mode is not used. A PI on the vehicle speed (average of both wheels) computes the speed command
+ * in the active control MODE, so that the speed is held also on inclines. The PI starts at the present command (no jolt at activation).
+ * when deactivated, the command fades back to the input request within CRUISE_RELEASE. A braking input request takes over at once.
 */
 // #define CRUISE_CONTROL_SUPPORT
 // #define SUPPORT_BUTTONS_LEFT              // Use button1 (Blue Left cable)  to activate/deactivate Cruise Control
 // #define SUPPORT_BUTTONS_RIGHT             // Use button1 (Blue Right cable) to activate/deactivate Cruise Control
+// #define CRUISE_PI_ENABLE                  // Closed-loop cruise control with the vehicle speed PI below
+#define CRUISE_KP           2560            // [-] Proportional gain in fixdt(0,16,8) [command / rpm]. In this case 2560 = 10 * 2^8
+#define CRUISE_KI           1280            // [-] Integral gain in fixdt(0,16,8) [command / (rpm * s)]
+#define CRUISE_RELEASE      500             // [ms] Time to fade from the cruise command back to the input request
 
 // ######################### END OF CRUISE CONTROL SETTINGS ##########################
 
@@ -525,6 +843,24 @@
   // #define ELECTRIC_BRAKE_MAX    100         // (0, 500) Maximum electric brake to be applied when input torque request is 0 (pedal fully released).
   // #define ELECTRIC_BRAKE_THRES  120         // (0, 500) Threshold below at which the electric brake starts engaging.
 
+  /* TORQUE MAP and LAUNCH CONTROL (TORQUE mode, pedals)
+   * The driving command is scaled by a factor linearly interpolated over the average speed between 4 breakpoints,
+   * e.g. to take back torque towards n_max. Outside the breakpoints the first or last factor is used. Braking is not scaled.
+   * Launch control: from standstill the driving command rises at most TORQUE_LAUNCH_RATE until TORQUE_LAUNCH_N_END is reached.
+   * Releasing the throttle is never delayed. The launch is armed again at standstill.
+   */
+  // #define TORQUE_MAP_ENABLE                 // [-] Flag to enable the speed-dependent torque map and the launch control
+  #define TORQUE_MAP_N1         0           // [rpm] Breakpoint 1
+  #define TORQUE_MAP_N2         300         // [rpm] Breakpoint 2
+  #define TORQUE_MAP_N3         600         // [rpm] Breakpoint 3
+  #define TORQUE_MAP_N4         900         // [rpm] Breakpoint 4
+  #define TORQUE_MAP_R1         100         // [%] Torque factor at breakpoint 1
+  #define TORQUE_MAP_R2         100         // [%] Torque factor at breakpoint 2
+  #define TORQUE_MAP_R3         80          // [%] Torque factor at breakpoint 3
+  #define TORQUE_MAP_R4         50          // [%] Torque factor at breakpoint 4
+  #define TORQUE_LAUNCH_RATE    1500        // [1/s] Maximum rise of the driving command during launch, e.g. 1500 = full torque in 0.67 s. 0 = no launch control
+  #define TORQUE_LAUNCH_N_END   150         // [rpm] Launch control ends above this speed
+
   #define MULTI_MODE_DRIVE                  // This option enables the selection of 3 driving modes at start-up using combinations of Brake and Throttle pedals (see below)
   #ifdef MULTI_MODE_DRIVE
       // BEGINNER MODE:     Power ON + Brake [released] + Throttle [released or pressed]
@@ -559,7 +895,7 @@
 
 // ############################ VARIANT_HOVERBOARD SETTINGS ############################
 // Communication:         [DONE]
-// Balancing controller:  [TODO]
+// Balancing controller:  [DONE] (BALANCE_ENABLE)
 #ifdef VARIANT_HOVERBOARD
   #define FLASH_WRITE_KEY     0x1008          // Flash memory writing key. Change this key to ignore the input calibrations from the flash memory and use the ones in config.h
   #define SIDEBOARD_SERIAL_USART2 1           // left sensor board cable. Number indicates priority for dual-input. Disable if ADC or PPM is used! 
@@ -573,6 +909,30 @@
   #define PRI_INPUT2          3, -1000, 0, 1000, 0  // Priority Sideboard can be used to send commands via an iBUS Receiver connected to the sideboard
   #define AUX_INPUT1          3, -1000, 0, 1000, 0  // not used
   #define AUX_INPUT2          3, -1000, 0, 1000, 0  // not used
+
+  /* Self-balancing: each wheel is balanced with the pitch of its own sideboard (pitch in deg*100, dPitch in gyro LSB).
+   * Cascade, stepped in the main loop every DELAY_IN_MAIN_LOOP with the latest sideboard frame:
+   * 1. Speed loop (PI):   the wheel command (1000 = N_MOT_MAX) is the speed target, the output is the pitch setpoint (limited to BAL_PITCH_SP_MAX)
+   * 2. Pitch loop (P):    the pitch error gives the pitch rate setpoint
+   * 3. Pitch rate loop (P): the pitch rate error gives the torque target (TORQUE mode)
+   * The controller engages when the platform is level (|pitch| < BAL_PITCH_START) and fades in within BAL_SOFT_TIME.
+   * It cuts off at a tilt above BAL_PITCH_MAX or at a sideboard timeout, until the platform is level again.
+  */
+  // #define BALANCE_ENABLE                   // [-] Enable the self-balancing controller
+  #define BAL_KP_N            256             // [-] Speed loop P gain in fixdt(0,16,8) [pitch / rpm]. In this case 256 = 1 * 2^8
+  #define BAL_KI_N            64              // [-] Speed loop I gain in fixdt(0,16,8) [pitch / (rpm * s)]
+  #define BAL_KP_P            210             // [-] Pitch loop gain in fixdt(0,16,8) [pitch rate / pitch]
+  #define BAL_KP_R            155             // [-] Pitch rate loop gain in fixdt(0,16,8) [torque / pitch rate]
+  #define BAL_PITCH_SP_MAX    500             // [deg*100] Maximum pitch setpoint of the speed loop
+  #define BAL_PITCH_START     300             // [deg*100] Engage only when the platform is this level
+  #define BAL_PITCH_MAX       3000            // [deg*100] Tilt-out: cut off above this pitch
+  #define BAL_SOFT_TIME       1000            // [ms] Soft start time
+  #define BAL_DIR_L           1               // [-] Pitch direction of the left sideboard: 1 or -1 (positive = tilted forward)
+  #define BAL_DIR_R           1               // [-] Pitch direction of the right sideboard: 1 or -1 (positive = tilted forward)
+  #ifdef BALANCE_ENABLE
+    #undef  CTRL_MOD_REQ
+    #define CTRL_MOD_REQ      TRQ_MODE        // the balancing controller outputs torque targets
+  #endif
 #endif
 // ######################## END OF VARIANT_HOVERBOARD SETTINGS #########################
 
@@ -587,7 +947,11 @@
   // #define SUPPORT_NUNCHUK
   #define GAMETRAK_CONNECTION_NORMAL    // for normal wiring according to the wiki instructions
   // #define GAMETRAK_CONNECTION_ALTERNATE // use this define instead if you messed up the gametrak ADC wiring (steering is speed, and length of the wire is steering)
-  #define ROT_P               1.2       // P coefficient for the direction controller. Positive / Negative values to invert gametrak steering direction.
+  #define ROT_P               307       // [-] P coefficient for the direction controller in fixdt(1,16,8): 307 = 1.2. Positive / Negative values to invert gametrak steering direction.
+  #define DIST_STEP           250       // [mm] Follow distance step for the power button and the nunchuk C (-) / Z (+) buttons
+  #define DIST_MIN            500       // [mm] Follow distance lower limit. Stepping outside [DIST_MIN, DIST_MAX] wraps around
+  #define DIST_MAX            2500      // [mm] Follow distance upper limit
+  #define DIST_CNT_PER_M      1345      // [-] Gametrak wire counts per meter
   // during nunchuk control (only relevant when activated)
   #define SPEED_COEFFICIENT   14746     // 0.9f - higher value == stronger. 0.0 to ~2.0?
   #define STEER_COEFFICIENT   8192      // 0.5f - higher value == stronger. if you do not want any steering, set it to 0.0; 0.0 to 1.0
@@ -789,6 +1153,149 @@
 
 
 // Functional checks
+#if defined(ENCODER_LEFT) && (defined(CONTROL_PPM_LEFT) || defined(CONTROL_PPM_RIGHT) || defined(CONTROL_PWM_LEFT) || defined(CONTROL_PWM_RIGHT))
+  #error ENCODER_LEFT and (CONTROL_PPM or CONTROL_PWM) not allowed. Both use TIM2.
+#endif
+
+#if (defined(ENCODER_LEFT) || defined(ENCODER_RIGHT)) && ENCODER_CPR > 65536
+  #error ENCODER_CPR does not fit the 16-bit encoder timer.
+#endif
+
+#if defined(HALL_CALIB_ENABLE) && (defined(VARIANT_HOVERBOARD) || defined(VARIANT_TRANSPOTTER))
+  #error HALL_CALIB_ENABLE is not available for VARIANT_HOVERBOARD and VARIANT_TRANSPOTTER. They do not use the EEPROM layout.
+#endif
+
+#if defined(HALL_CALIB_ENABLE) && !defined(DEBUG_SERIAL_PROTOCOL)
+  #error HALL_CALIB_ENABLE needs DEBUG_SERIAL_PROTOCOL to start the calibration.
+#endif
+
+#if defined(HALL_CALIB_ENABLE) && (HALL_CALIB_VOLT <= 0 || HALL_CALIB_VOLT > 300)
+  #error HALL_CALIB_VOLT has to be in (0, 300].
+#endif
+
+#if defined(RIPPLE_COMP_ENABLE) && (CTRL_TYP_SEL != FOC_CTRL || !defined(DEBUG_SERIAL_PROTOCOL) || defined(VARIANT_HOVERBOARD) || defined(VARIANT_TRANSPOTTER))
+  #error RIPPLE_COMP_ENABLE needs FOC_CTRL and DEBUG_SERIAL_PROTOCOL. Not available for VARIANT_HOVERBOARD and VARIANT_TRANSPOTTER.
+#endif
+
+#if defined(RIPPLE_COMP_ENABLE) && (RIPPLE_COMP_BINS > 36 || RIPPLE_COMP_BINS % 2 != 0)
+  #error RIPPLE_COMP_BINS has to be even and at most 36.
+#endif
+
+#if defined(POSITION_CONTROL) && (CTRL_TYP_SEL != FOC_CTRL)
+  #error POSITION_CONTROL is only available for FOC_CTRL.
+#endif
+
+#if defined(SCURVE_ENABLE) && (SCURVE_ACC_MAX <= 0 || SCURVE_ACC_MAX > 32767 || SCURVE_JERK_MAX <= 0 || SCURVE_JERK_MAX > 32767)
+  #error SCURVE_ACC_MAX and SCURVE_JERK_MAX have to be in (0, 32767].
+#endif
+
+#if defined(BIQUAD_ENABLE) && (defined(SCURVE_ENABLE) || defined(VARIANT_TRANSPOTTER))
+  #error BIQUAD_ENABLE is not available with SCURVE_ENABLE or VARIANT_TRANSPOTTER, they do not use the main loop command filter.
+#endif
+
+#if defined(BIQUAD_ENABLE) && (BIQUAD_SPD_TYP > 1 || BIQUAD_STR_TYP > 1 || BIQUAD_SPD_FC <= 0 || BIQUAD_STR_FC <= 0 || \
+    BIQUAD_SPD_FC >= 5000 / DELAY_IN_MAIN_LOOP || BIQUAD_STR_FC >= 5000 / DELAY_IN_MAIN_LOOP || BIQUAD_SPD_Q <= 0 || BIQUAD_STR_Q <= 0)
+  #error BIQUAD types have to be 0 or 1, the frequencies in (0, 5000 / DELAY_IN_MAIN_LOOP) and Q above 0.
+#endif
+
+#if defined(BALANCE_ENABLE) && (!defined(VARIANT_HOVERBOARD) || CTRL_TYP_SEL != FOC_CTRL || !defined(SIDEBOARD_SERIAL_USART2) || !defined(SIDEBOARD_SERIAL_USART3))
+  #error BALANCE_ENABLE is only available for VARIANT_HOVERBOARD with FOC_CTRL and both sideboards.
+#endif
+
+#if defined(BALANCE_ENABLE) && defined(VARIANT_HOVERBOARD) && (BAL_PITCH_START <= 0 || BAL_PITCH_START >= BAL_PITCH_MAX || BAL_SOFT_TIME < DELAY_IN_MAIN_LOOP)
+  #error BAL_PITCH_START has to be in (0, BAL_PITCH_MAX) and BAL_SOFT_TIME at least DELAY_IN_MAIN_LOOP.
+#endif
+
+#if defined(ABS_BRAKE_ENABLE) && (CTRL_TYP_SEL != FOC_CTRL)
+  #error ABS_BRAKE_ENABLE is only available for FOC_CTRL (TRQ_MODE or SPD_MODE).
+#endif
+
+#if defined(TRACTION_CTRL) && (CTRL_TYP_SEL != FOC_CTRL)
+  #error TRACTION_CTRL is only available for FOC_CTRL (TRQ_MODE).
+#endif
+
+#if defined(REGEN_LIMIT_ENABLE) && (CTRL_TYP_SEL != FOC_CTRL)
+  #error REGEN_LIMIT_ENABLE is only available for FOC_CTRL.
+#endif
+
+#if defined(REGEN_LIMIT_ENABLE) && (REGEN_V_STOP <= REGEN_V_START)
+  #error REGEN_V_STOP has to be above REGEN_V_START.
+#endif
+
+#if defined(BAT_LIMIT_ENABLE) && (CTRL_TYP_SEL != FOC_CTRL)
+  #error BAT_LIMIT_ENABLE is only available for FOC_CTRL.
+#endif
+
+#if defined(BAT_LIMIT_ENABLE) && (BAT_I_PEAK < BAT_I_CONT)
+  #error BAT_I_PEAK has to be at least BAT_I_CONT.
+#endif
+
+#if defined(MOT_THERM_ENABLE) && (CTRL_TYP_SEL != FOC_CTRL)
+  #error MOT_THERM_ENABLE is only available for FOC_CTRL.
+#endif
+
+#if defined(MOT_THERM_ENABLE) && (MOT_THERM_T_AMB >= MOT_THERM_T_START || MOT_THERM_T_START >= MOT_THERM_T_MAX)
+  #error MOT_THERM_T_AMB, MOT_THERM_T_START and MOT_THERM_T_MAX have to be increasing.
+#endif
+
+#if TEMP_DERATE_ENABLE && (TEMP_DERATE_START >= TEMP_DERATE_END || TEMP_DERATE_MIN < 0 || TEMP_DERATE_MIN > 100)
+  #error TEMP_DERATE_END has to be above TEMP_DERATE_START and TEMP_DERATE_MIN in [0, 100].
+#endif
+
+#if defined(BUMPLESS_ENABLE) && (BUMPLESS_TIME <= 0 || BUMPLESS_TIME > 65535)
+  #error BUMPLESS_TIME has to be in (0, 65535].
+#endif
+
+#if defined(INPUT_CURVE_ENABLE) && (INPUT1_EXPO < 0 || INPUT1_EXPO > 100 || INPUT2_EXPO < 0 || INPUT2_EXPO > 100)
+  #error INPUT1_EXPO and INPUT2_EXPO have to be in [0, 100].
+#endif
+
+#if defined(CRUISE_PI_ENABLE) && !defined(CRUISE_CONTROL_SUPPORT)
+  #error CRUISE_PI_ENABLE requires CRUISE_CONTROL_SUPPORT.
+#endif
+
+#if defined(CRUISE_PI_ENABLE) && (CRUISE_RELEASE < DELAY_IN_MAIN_LOOP || CRUISE_RELEASE > 32767)
+  #error CRUISE_RELEASE has to be in [DELAY_IN_MAIN_LOOP, 32767].
+#endif
+
+#if defined(HILL_HOLD_ENABLE) && (CTRL_TYP_SEL != FOC_CTRL || CTRL_MOD_REQ != TRQ_MODE)
+  #error HILL_HOLD_ENABLE is only available for FOC TORQUE mode.
+#endif
+
+#if defined(HILL_HOLD_ENABLE) && defined(STANDSTILL_HOLD_ENABLE)
+  #error HILL_HOLD_ENABLE replaces STANDSTILL_HOLD_ENABLE, enable only one of them.
+#endif
+
+#if defined(HILL_HOLD_ENABLE) && (HILL_HOLD_I_CONT <= 0 || HILL_HOLD_I_CONT >= HILL_HOLD_I_MAX || HILL_HOLD_I_MAX > I_MOT_MAX)
+  #error HILL_HOLD currents have to be 0 < HILL_HOLD_I_CONT < HILL_HOLD_I_MAX <= I_MOT_MAX.
+#endif
+
+#if defined(HILL_HOLD_ENABLE) && (HILL_HOLD_T_MAX <= 0 || HILL_HOLD_T_MAX > 65535 || HILL_HOLD_RELEASE <= 0 || HILL_HOLD_RELEASE > 32768)
+  #error HILL_HOLD_T_MAX has to be in (0, 65535] and HILL_HOLD_RELEASE in (0, 32768].
+#endif
+
+#if defined(STEER_SCHED_ENABLE) && (STEER_SCHED_N1 < 0 || STEER_SCHED_N2 <= STEER_SCHED_N1 || STEER_SCHED_N3 <= STEER_SCHED_N2 || \
+    STEER_SCHED_R1 > 16384 || STEER_SCHED_R2 > 16384 || STEER_SCHED_R3 > 16384)
+  #error STEER_SCHED breakpoints have to be increasing, the factors in [0, 16384].
+#endif
+
+#if defined(TORQUE_MAP_ENABLE) && (!defined(VARIANT_HOVERCAR) || CTRL_MOD_REQ != TRQ_MODE)
+  #error TORQUE_MAP_ENABLE is only available for VARIANT_HOVERCAR in TORQUE mode.
+#endif
+
+#if defined(TORQUE_MAP_ENABLE) && (TORQUE_MAP_N1 < 0 || TORQUE_MAP_N2 <= TORQUE_MAP_N1 || TORQUE_MAP_N3 <= TORQUE_MAP_N2 || TORQUE_MAP_N4 <= TORQUE_MAP_N3 || \
+    TORQUE_MAP_R1 > 100 || TORQUE_MAP_R2 > 100 || TORQUE_MAP_R3 > 100 || TORQUE_MAP_R4 > 100 || TORQUE_LAUNCH_RATE < 0 || TORQUE_LAUNCH_N_END <= 0)
+  #error TORQUE_MAP breakpoints have to be increasing, the factors in [0, 100] %.
+#endif
+
+#if defined(VARIANT_TRANSPOTTER) && (DIST_STEP <= 0 || DIST_MIN < DIST_STEP || DIST_MAX <= DIST_MIN || DIST_MAX > 3000)
+  #error TRANSPOTTER distances have to be 0 < DIST_STEP <= DIST_MIN < DIST_MAX <= 3000 mm.
+#endif
+
+#if !defined(POSITION_CONTROL) && (CTRL_MOD_REQ == POS_MODE)
+  #error POS_MODE needs POSITION_CONTROL.
+#endif
+
 #if (defined(CONTROL_PPM_LEFT) || defined(CONTROL_PPM_RIGHT)) && !defined(PPM_NUM_CHANNELS)
   #error Total number of PPM channels needs to be set
 #endif
@@ -185,6 +185,20 @@
 #define BUTTON2_PORT        GPIOB
 #endif
 
+#if defined(ENCODER_LEFT)
+#define LEFT_ENC_TIM        TIM2
+#define LEFT_ENC_TIM_CLK_ENABLE() __HAL_RCC_TIM2_CLK_ENABLE()
+#define LEFT_ENC_REMAP()    do { __HAL_RCC_AFIO_CLK_ENABLE(); __HAL_AFIO_REMAP_SWJ_NOJTAG(); __HAL_AFIO_REMAP_TIM2_PARTIAL_1(); } while (0)
+#define LEFT_ENC_A_PIN      GPIO_PIN_15
+#define LEFT_ENC_A_PORT     GPIOA
+#define LEFT_ENC_B_PIN      GPIO_PIN_3
+#define LEFT_ENC_B_PORT     GPIOB
+#endif
+
+#if defined(ENCODER_RIGHT) && !defined(RIGHT_ENC_TIM)
+  #error ENCODER_RIGHT needs custom pins: define RIGHT_ENC_TIM, RIGHT_ENC_TIM_CLK_ENABLE() and RIGHT_ENC_A/B_PIN/PORT
+#endif
+
 #define DELAY_TIM_FREQUENCY_US 1000000
 
 #define MILLI_R (R * 1000)
@@ -211,10 +225,6 @@
 #define ARRAY_LEN(x) (uint32_t)(sizeof(x) / sizeof(*(x)))
 #define MAP(x, in_min, in_max, out_min, out_max) (((((x) - (in_min)) * ((out_max) - (out_min))) / ((in_max) - (in_min))) + (out_min))
 
-#if defined(PRINTF_FLOAT_SUPPORT) && (defined(DEBUG_SERIAL_USART2) || defined(DEBUG_SERIAL_USART3)) && defined(__GNUC__)
-    asm(".global _printf_float");     // this is the magic trick for printf to support float. Warning: It will increase code considerably! Better to avoid!
-#endif
-
 
 typedef struct {
   uint16_t dcr; 
@@ -239,6 +249,7 @@ typedef enum {
 // Define I2C, Nunchuk, PPM, PWM functions
 void I2C_Init(void);
 nunchuk_state Nunchuk_Read(void);
+uint32_t Nunchuk_SampleAge(void);
 void PPM_Init(void);
 void PPM_ISR_Callback(void);
 void PWM_Init(void);
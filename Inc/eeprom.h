@@ -209,7 +209,7 @@
 #define PAGE_FULL             ((uint8_t)0x80)
 
 /* Variables' number */
-#define NB_OF_VAR             ((uint8_t)0x13)       /* 19 Variables */
+#define NB_OF_VAR             ((uint8_t)0x52)       /* 82 Variables */
 
 /* Exported types ------------------------------------------------------------*/
 /* Exported macro ------------------------------------------------------------*/
@@ -0,0 +1,46 @@
+/**
+  * This file is part of the hoverboard-firmware-hack project.
+  *
+  * Copyright (C) 2020-2021 Emanuel FERU <aerdronix@gmail.com>
+  *
+  * This program is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * (at your option) any later version.
+  *
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Define to prevent recursive inclusion
+#ifndef FORMAT_H
+#define FORMAT_H
+
+#include <stdint.h>
+
+/* Integer-only number formatting for the LCD and the debug serial output.
+ * The fmtXxx() writers put a zero terminated string in s and return its length (without the terminator).
+ * Buffer sizes: fmtInt 12 chars, fmtHex 9 chars, fmtFix 12 chars.
+ */
+#define FMT_FIX_DIGITS_MAX    4         // [-] maximum number of decimals in fmtFix
+
+uint8_t fmtUInt(char *s, uint32_t x);
+uint8_t fmtInt(char *s, int32_t x);
+uint8_t fmtHex(char *s, uint32_t x, uint8_t digits);
+uint8_t fmtFix(char *s, int32_t x, uint16_t scale, uint8_t digits);
+
+/* printf replacement for the debug serial, without the C library formatter. Supported conversions:
+ * %d %i %u %x %X %c %s %% with an optional '0' flag, field width and 'l' length modifier
+ */
+#ifdef __GNUC__
+int fmtPrint(const char *fmt, ...) __attribute__((format(printf, 1, 2)));
+#else
+int fmtPrint(const char *fmt, ...);
+#endif
+
+#endif  // FORMAT_H
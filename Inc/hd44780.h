@@ -60,6 +60,14 @@ typedef enum{
 	NUMBER_OF_LINES_2=1
 } LCD_NUMBER_OF_LINES;
 
+/** Framebuffer size and maximum number of characters sent per asynchronous transfer */
+#define LCD_FB_COLS						16
+#define LCD_FB_ROWS						2
+#define LCD_FB_BURST					8
+#if LCD_FB_ROWS * LCD_FB_COLS > 32
+  #error The framebuffer dirty mask holds 32 characters.
+#endif
+
 /**
  * Structure that hold all the required variables in
  * order to simplify the communication process
@@ -69,8 +77,10 @@ typedef struct{
 	uint8_t 				D;
 	uint8_t 				C;
 	uint8_t 				B;
-	char 					lcdbuf[2][16];		/**< Buffer for the LCD */
-	int 					x, oldx, y, oldy;
+	char 					lcdbuf[LCD_FB_ROWS][LCD_FB_COLS];	/**< Framebuffer for the LCD */
+	int 					x, oldx, y, oldy;	/**< Framebuffer cursor */
+	uint32_t				dirty;				/**< One bit per framebuffer character not yet sent to the LCD */
+	uint8_t					txbuf[4 * (LCD_FB_BURST + 1)];	/**< DMA buffer: 4 expander bytes per command or character */
 	uint8_t 				state;				/**< Holds current state of the PCF8574 expander */
 	uint32_t*				pins;				/**< Array of pins based on your hardware (wiring) */
 	LCD_TYPE				type;				/**< Type of hardware you want to use */
@@ -238,8 +248,15 @@ LCD_RESULT LCD_ShiftDisplay(LCD_PCF8574_HandleTypeDef* handle, uint8_t direction
  */
 LCD_RESULT LCD_WriteNumber(LCD_PCF8574_HandleTypeDef* handle, unsigned long n, uint8_t base);
 
-
-LCD_RESULT LCD_WriteFloat(LCD_PCF8574_HandleTypeDef* handle, double number, uint8_t digits);
+/**
+ * Writes a fixed-point number to the LCD, e.g. number = 1234, scale = 100, digits = 1 writes "12.3"
+ * @param	handle - a pointer to the LCD handle
+ * @param	number - the scaled integer value
+ * @param	scale - number of units per 1
+ * @param	digits - number of decimals (max FMT_FIX_DIGITS_MAX)
+ * @return	whether the function was successful or not
+ */
+LCD_RESULT LCD_WriteFixed(LCD_PCF8574_HandleTypeDef* handle, int32_t number, uint16_t scale, uint8_t digits);
 
 /**
  * Sets the mode by which data is written to the LCD
@@ -283,6 +300,45 @@ LCD_RESULT LCD_StateLEDControl(LCD_PCF8574_HandleTypeDef* handle, uint8_t on);
  */
 LCD_RESULT LCD_StateWriteBit(LCD_PCF8574_HandleTypeDef* handle, uint8_t value, LCD_PIN pin);
 
+/**
+ * Clears the framebuffer and sets its cursor to the home position.
+ * The framebuffer functions do not access the I2C bus, LCD_FB_Update() sends the changes in the background.
+ * @param	handle - a pointer to the LCD handle
+ */
+void LCD_FB_Clear(LCD_PCF8574_HandleTypeDef* handle);
+
+/**
+ * Sets the framebuffer cursor
+ * @param	handle - a pointer to the LCD handle
+ * @param	x - column
+ * @param	y - row
+ */
+void LCD_FB_SetLocation(LCD_PCF8574_HandleTypeDef* handle, uint8_t x, uint8_t y);
+
+/**
+ * Writes a string to the framebuffer at the cursor. Only the characters that change are marked for sending.
+ * @param	handle - a pointer to the LCD handle
+ * @param	s - string, clipped at the end of the row
+ */
+void LCD_FB_WriteString(LCD_PCF8574_HandleTypeDef* handle, const char *s);
+
+/**
+ * Writes a fixed-point number to the framebuffer, see LCD_WriteFixed()
+ * @param	handle - a pointer to the LCD handle
+ * @param	number - the scaled integer value
+ * @param	scale - number of units per 1
+ * @param	digits - number of decimals (max FMT_FIX_DIGITS_MAX)
+ */
+void LCD_FB_WriteFixed(LCD_PCF8574_HandleTypeDef* handle, int32_t number, uint16_t scale, uint8_t digits);
+
+/**
+ * Sends the next run of changed characters (max LCD_FB_BURST) over I2C DMA. Never blocks:
+ * returns immediately if nothing changed or the previous transfer is still ongoing. Call it periodically.
+ * @param	handle - a pointer to the LCD handle
+ * @return	whether a transfer was started or not needed (LCD_OK), or the LCD is in error (LCD_ERROR)
+ */
+LCD_RESULT LCD_FB_Update(LCD_PCF8574_HandleTypeDef* handle);
+
 /**
  * Waits until the busy flag is reset
  * @param	handle - a pointer to the LCD handle
@@ -41,7 +41,7 @@ typedef enum{
 typedef struct{
 	uint8_t				PCF_I2C_ADDRESS;	/**< address of the chip you want to communicate with */
 	uint32_t			PCF_I2C_TIMEOUT;	/**< timeout value for the communication in milliseconds */
-	I2C_HandleTypeDef 	i2c;				/**< I2C_HandleTypeDef structure */
+	I2C_HandleTypeDef* 	i2c;				/**< pointer to the I2C_HandleTypeDef structure (shared with the I2C interrupt handlers) */
 	void				(*errorCallback)(PCF8574_RESULT);
 } PCF8574_HandleTypeDef;
 
@@ -71,6 +71,22 @@ PCF8574_RESULT PCF8574_DeInit(PCF8574_HandleTypeDef* handle);
  */
 PCF8574_RESULT PCF8574_Write(PCF8574_HandleTypeDef* handle, uint8_t val);
 
+/**
+ * Starts writing a sequence of values to the port of PCF8574 over DMA, without waiting for the end of the transfer
+ * @param	handle - a pointer to the PCF8574 handle
+ * @param	buf - values to be written to the port, must stay valid until the transfer is finished
+ * @param	len - number of values
+ * @return	whether the transfer was started or not (the bus is busy with a previous transfer)
+ */
+PCF8574_RESULT PCF8574_WriteAsync(PCF8574_HandleTypeDef* handle, uint8_t* buf, uint16_t len);
+
+/**
+ * Checks if the I2C bus is free for a new transfer
+ * @param	handle - a pointer to the PCF8574 handle
+ * @return	1 if the bus is free, 0 if a transfer is ongoing
+ */
+uint8_t PCF8574_IsReady(PCF8574_HandleTypeDef* handle);
+
 /**
  * Reads the current state of the port of PCF8574
  * @param	handle - a pointer to the PCF8574 handle
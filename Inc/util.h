@@ -42,6 +42,16 @@
       uint16_t  checksum;
     } SerialCommand;
   #endif
+  #ifdef POSITION_CONTROL
+    typedef struct{
+      uint16_t  start;
+      uint16_t  mode;       // 0 = absolute, 1 = relative to the current target
+      int32_t   posL;       // Left position target [counts]
+      int32_t   posR;       // Right position target [counts]
+      uint16_t  spdMax;     // Maximum speed command [0, 1000]. 0 = POS_SPD_MAX
+      uint16_t  checksum;
+    } SerialPosition;
+  #endif
 #endif
 #if defined(SIDEBOARD_SERIAL_USART2) || defined(SIDEBOARD_SERIAL_USART3)
     typedef struct{
@@ -65,12 +75,14 @@ typedef struct {
   int16_t   mid;    // middle
   int16_t   max;    // maximum
   int16_t   dband;  // deadband
+  int16_t   expo;   // response curve [0, 100] %
 } InputStruct;
 
 // Initialization Functions
 void BLDC_Init(void);
 void Input_Lim_Init(void);
 void Input_Init(void);
+void Biquad_Init(void);
 void UART_DisableRxErrors(UART_HandleTypeDef *huart);
 
 // General Functions
@@ -85,9 +97,15 @@ void updateCurSpdLim(void);
 void standstillHold(void);
 void electricBrake(uint16_t speedBlend, uint8_t reverseDir);
 void cruiseControl(uint8_t button);
+void speedGainSched(void);
+void derateLimits(void);
+void balanceCtrl(int16_t *cmdL, int16_t *cmdR);
+int8_t hallCalib(void);
+int8_t rippleLearn(void);
 int  checkInputType(int16_t min, int16_t mid, int16_t max);
 
 // Input Functions
+int16_t inputCurve(int16_t x, int16_t x_max, int16_t expo);
 void calcInputCmd(InputStruct *in, int16_t out_min, int16_t out_max);
 void readInputRaw(void);
 void handleTimeout(void);
@@ -100,6 +118,9 @@ void usart_process_debug(uint8_t *userCommand, uint32_t len);
 #if defined(CONTROL_SERIAL_USART2) || defined(CONTROL_SERIAL_USART3)
 void usart_process_command(SerialCommand *command_in, SerialCommand *command_out, uint8_t usart_idx);
 #endif
+#if (defined(CONTROL_SERIAL_USART2) || defined(CONTROL_SERIAL_USART3)) && defined(POSITION_CONTROL)
+void usart_process_position(SerialPosition *position_in, uint8_t usart_idx);
+#endif
 #if defined(SIDEBOARD_SERIAL_USART2) || defined(SIDEBOARD_SERIAL_USART3)
 void usart_process_sideboard(SerialSideboard *Sideboard_in, SerialSideboard *Sideboard_out, uint8_t usart_idx);
 #endif
@@ -112,12 +133,50 @@ void sideboardSensors(uint8_t sensors);
 void saveConfig(void);
 void poweroff(void);
 void poweroffPressCheck(void);
+void setDistanceStep(int16_t dDist);
 
 // Filtering Functions
 void filtLowPass32(int32_t u, uint16_t coef, int32_t *y);
+typedef struct {
+  uint8_t   typ;            // 0: low-pass, 1: notch
+  uint16_t  f_c;            // cutoff / notch frequency [Hz*10]
+  uint16_t  q;              // quality factor, fixdt(0,16,8)
+  int32_t   b[3];           // numerator coefficients, fixdt(1,32,28)
+  int32_t   a[2];           // denominator coefficients a1, a2, fixdt(1,32,28). a0 is normalized to 1
+  int32_t   x[2];           // previous inputs, fixdt(1,32,16)
+  int32_t   y[2];           // previous outputs, fixdt(1,32,16)
+  int32_t   e;              // accumulator bits truncated in the last step [0, 2^28), fed back into the next step
+} Biquad;
+void biquadDesign(uint16_t fs, Biquad *x);
+void filtBiquad32(int32_t u, Biquad *x, int32_t *y);
 void rateLimiter16(int16_t u, int16_t rate, int16_t *y);
 void mixerFcn(int16_t rtu_speed, int16_t rtu_steer, int16_t *rty_speedR, int16_t *rty_speedL);
 
+// S-Curve Function
+typedef struct {
+  int16_t   velMax;         // maximum output [0, 1000]
+  int16_t   accMax;         // maximum acceleration [-/s]
+  int16_t   jerkMax;        // maximum jerk [-/s^2]
+  int32_t   y;              // output in fixdt(1,32,16)
+  int32_t   a;              // acceleration in fixdt(1,32,16) [-/s]
+} SCurve;
+int16_t sCurveStep(int16_t u, SCurve *x);
+
+// Gain Schedule Function
+typedef struct {
+  int16_t   n[3];           // absolute speed breakpoints [rpm], increasing
+  uint16_t  kp[3];          // cf_nKp at the breakpoints, fixdt(0,16,12)
+  uint16_t  ki[3];          // cf_nKi at the breakpoints, fixdt(0,16,16)
+} GainSched;
+void gainSchedCalc(int16_t n, const GainSched *gs, uint16_t *kp, uint16_t *ki);
+
+// Steering Schedule Function
+typedef struct {
+  int16_t   n[3];           // absolute speed breakpoints [rpm], increasing
+  uint16_t  r[3];           // steering factors at the breakpoints, fixdt(0,16,14) [0, 16384]
+} SteerSched;
+uint16_t steerSchedCalc(int16_t n, const SteerSched *ss);
+
 // Multiple Tap Function
 typedef struct {
   uint32_t  t_timePrev;
@@ -127,5 +186,199 @@ typedef struct {
 } MultipleTap;
 void multipleTapDet(int16_t u, uint32_t timeNow, MultipleTap *x);
 
+// Encoder Function
+typedef struct {
+  uint16_t  z_cntOffset;    // counter offset found by the hall alignment
+  int8_t    z_hallPosPrev;  // previous hall position [0, 5]. -1 = unknown
+  uint8_t   z_alignErrCnt;  // number of failed hall checks
+  uint8_t   b_aligned;      // encoder angle is valid -> use it as measured angle
+  int16_t   a_hallOffset;   // angle offset of the hall transitions in fixdt(1,16,4) from the hall calibration
+} EncoderAngle;
+int16_t encoderAngleCalc(uint16_t cnt, uint8_t hallA, uint8_t hallB, uint8_t hallC, uint8_t polePairs, EncoderAngle *x);
+
+// Hall Calibration Function
+typedef struct {
+  uint8_t   z_map[8];       // raw hall state -> hall state expected by the controller
+  int16_t   a_offset;       // mean angle offset of the hall transitions in fixdt(1,16,4)
+} HallCalib;
+uint8_t hallCalibCalc(const int32_t *sumCos, const int32_t *sumSin, HallCalib *x);
+
+// Wheel Synchronisation Function
+typedef struct {
+  int32_t   z_intL;         // left integrator state in fixdt(1,32,16)
+  int32_t   z_intR;         // right integrator state in fixdt(1,32,16)
+  int16_t   r_corrL;        // left target correction
+  int16_t   r_corrR;        // right target correction
+  uint16_t  kp;             // proportional gain in fixdt(0,16,8)
+  uint16_t  ki;             // integral gain in fixdt(0,16,16)
+  int16_t   r_corrMax;      // correction limit [0, 1000]
+} SyncCtrl;
+void syncCtrlStep(int16_t tgtL, int16_t tgtR, int16_t nL, int16_t nR, int16_t n_max, uint8_t b_ena, SyncCtrl *x);
+
+// Traction Control Function
+typedef struct {
+  int16_t   a_max;          // plausible acceleration at target 1000 [rpm/s]
+  int16_t   dn_max;         // plausible speed difference to the other wheel [rpm]
+  uint16_t  r_dec;          // torque factor decrease per step while slipping in fixdt(0,16,15)
+  uint16_t  r_inc;          // torque factor recovery per step in fixdt(0,16,15)
+  int32_t   z_acc;          // filtered acceleration in fixdt(1,32,16) [rpm/s]
+  int16_t   n_prev;         // previous speed [rpm]
+  uint16_t  r_fac;          // torque factor in fixdt(0,16,15): 32768 = 1
+  uint8_t   b_slip;         // slip detected
+} TractionCtrl;
+int16_t tractionCtrlStep(int16_t tgt, int16_t n, int16_t nOther, uint8_t b_ena, TractionCtrl *x);
+
+// Anti-Lock Brake Function
+typedef struct {
+  int16_t   a_max;          // plausible deceleration while braking [rpm/s]
+  int16_t   dn_max;         // plausible speed difference to the other wheel [rpm]
+  int16_t   n_min;          // no modulation below this speed [rpm]
+  uint16_t  r_dec;          // brake factor decrease per step while locking in fixdt(0,16,15)
+  uint16_t  r_inc;          // brake factor recovery per step in fixdt(0,16,15)
+  int32_t   z_dec;          // filtered deceleration in fixdt(1,32,16) [rpm/s], positive = slowing down
+  int16_t   n_prev;         // previous speed [rpm]
+  uint16_t  r_fac;          // brake factor in fixdt(0,16,15): 32768 = 1
+  uint8_t   b_lock;         // wheel lock detected
+} AbsBrake;
+int16_t absBrakeStep(int16_t tgt, int16_t n, int16_t nOther, int16_t n_max, uint8_t z_ctrlMod, uint8_t b_ena, AbsBrake *x);
+
+// DC Current Limit Functions
+typedef struct {
+  int16_t   i_max;          // maximum regen DC current of both motors in ADC bits (A2BIT_CONV)
+  int16_t   u_start;        // battery voltage to start the foldback (batVoltage scaling)
+  int16_t   u_stop;         // battery voltage with no regeneration
+  int16_t   i_regen;        // regen DC current, positive = into the battery
+  uint16_t  r_facI;         // current limiter factor in fixdt(0,16,15)
+  uint16_t  r_fac;          // regen factor in fixdt(0,16,15): 32768 = no limitation
+} RegenLim;
+void    regenLimStep(int16_t iDC, int16_t uBat, RegenLim *x);
+typedef struct {
+  int16_t   i_cont;         // continuous battery current in ADC bits (A2BIT_CONV)
+  int16_t   i_peak;         // peak battery current in ADC bits
+  uint16_t  t_peak;         // time at i_peak until the limit is back at i_cont [ms]
+  int32_t   z_budget;       // used peak budget [bits * ms]
+  int16_t   i_bat;          // battery current, positive = out of the battery
+  int16_t   i_lim;          // actual battery current limit in ADC bits
+  uint16_t  r_fac;          // battery limit factor in fixdt(0,16,15): 32768 = no limitation
+} BatLim;
+void    batLimStep(int16_t iDC, BatLim *x);
+int16_t dcLimApply(int16_t tgt, int16_t n, int16_t n_max, uint8_t z_ctrlMod, uint16_t r_fac, uint8_t b_regen);
+
+// Bumpless Transfer Functions
+typedef struct {
+  uint16_t  t_decay;        // time to remove the offset after a transfer [steps]
+  uint8_t   z_ctrlMod;      // control mode of the last step
+  uint8_t   z_ctrlTyp;      // control type of the last step
+  int32_t   z_offset;       // target offset in fixdt(1,32,16)
+  int32_t   dz_offset;      // offset decrease per step in fixdt(1,32,16)
+} Bumpless;
+int16_t bumplessOpTgt(uint8_t z_ctrlMod, uint8_t z_ctrlTyp, int16_t n, int16_t iq, int16_t u, int16_t n_max, int16_t i_max, int16_t u_max);
+int16_t bumplessStep(int16_t tgt, int16_t tgtOp, uint8_t z_ctrlMod, uint8_t z_ctrlTyp, uint8_t b_ena, Bumpless *x);
+
+// Limit Derating Functions
+#if defined(MOT_THERM_ENABLE) || TEMP_DERATE_ENABLE
+  #define LIM_DERATE                    // i_max (and n_max) are derated in the main loop, see derateLimits()
+#endif
+typedef struct {
+  int16_t   x_nom;          // nominal limit (EEPROM, debug protocol, calibration)
+  int16_t   x_set;          // derated limit written last
+} LimDerate;
+int16_t limDerate(int16_t x, int16_t x_min, uint16_t r_fac, uint16_t r_scale, LimDerate *d);
+typedef struct {
+  int16_t   i_cont;         // continuous phase current in fixdt(1,16,4), same scaling as i_max
+  uint16_t  t_tau;          // thermal time constant [s]
+  uint16_t  n_steps;        // number of calls per second
+  int16_t   T_amb;          // ambient temperature [°C*10]
+  int16_t   T_start;        // winding temperature to start the derating [°C*10]
+  int16_t   T_max;          // winding temperature with the limit at i_cont [°C*10]
+  uint64_t  z_i2Sum;        // sum of the squared current over 1 s [ADC bits^2]
+  uint16_t  z_cnt;          // number of samples in z_i2Sum
+  int32_t   z_heat;         // heat state in fixdt(1,32,20): 1 = steady state at i_cont
+  int16_t   T_wind;         // estimated winding temperature [°C*10]
+  uint16_t  r_fac;          // derating factor in fixdt(0,16,15): 32768 = no derating, 0 = limit at i_cont
+} MotTherm;
+void    motThermStep(int16_t iq, int16_t id, MotTherm *x);
+
+// Ripple Compensation Functions
+typedef struct {
+  int8_t    r_comp[RIPPLE_COMP_BINS];   // compensation per electrical angle point [torque target, 1000 = i_max]
+  int32_t   z_iqSum[RIPPLE_COMP_BINS];  // learning: sum of the measured iq per point
+  uint16_t  z_iqCnt[RIPPLE_COMP_BINS];  // learning: number of samples per point
+} RippleComp;
+int16_t rippleCompCalc(int16_t a_elecAngle, const RippleComp *x);
+void    rippleLearnStep(int16_t a_elecAngle, int16_t iq, RippleComp *x);
+uint8_t rippleLearnCalc(int16_t i_max, RippleComp *x);
+
+// Position Control Functions
+typedef struct {
+  int32_t   z_pos;          // measured position [counts]
+  int32_t   z_posTgt;       // position target [counts]
+  int32_t   z_cntPrev;      // previous hall position [0, 5] or encoder counter. -1 = unknown
+  int16_t   r_spdMax;       // maximum speed command [0, 1000]
+  int16_t   r_spdCmd;       // speed command output
+  uint8_t   b_reached;      // position target reached
+} PosCtrl;
+void posCountHall(uint8_t hallA, uint8_t hallB, uint8_t hallC, PosCtrl *x);
+void posCountEnc(uint16_t cnt, PosCtrl *x);
+void posCtrlStep(uint16_t kp, uint8_t b_ena, PosCtrl *x);
+
+// Balance Control Functions
+typedef struct {
+  uint16_t  kpN;            // speed loop P gain fixdt(0,16,8) [pitch / rpm]
+  uint16_t  kiN;            // speed loop I gain fixdt(0,16,8) [pitch / (rpm * s)]
+  uint16_t  kpP;            // pitch loop gain fixdt(0,16,8) [pitch rate / pitch]
+  uint16_t  kpR;            // pitch rate loop gain fixdt(0,16,8) [torque / pitch rate]
+  int16_t   pitchSpMax;     // pitch setpoint limit [deg*100]
+  int16_t   pitchStart;     // engage below this pitch [deg*100]
+  int16_t   pitchMax;       // tilt-out pitch [deg*100]
+  uint16_t  t_soft;         // soft start time [ms]
+  int32_t   z_intN;         // speed loop integrator fixdt(1,32,16) [pitch]
+  uint16_t  r_soft;         // soft start factor fixdt(0,16,15)
+  int16_t   r_trq;          // torque target [-1000, 1000]
+  uint8_t   b_acv;          // balancing active
+} BalanceCtrl;
+void balanceStep(int16_t pitch, int16_t dPitch, int16_t n, int16_t n_tgt, uint8_t b_ena, BalanceCtrl *x);
+
+// Cruise Control Functions
+typedef struct {
+  uint16_t  kp;             // proportional gain fixdt(0,16,8) [command / rpm]
+  uint16_t  ki;             // integral gain fixdt(0,16,8) [command / (rpm * s)]
+  uint16_t  t_release;      // time to fade back to the input [ms]
+  int16_t   n_tgt;          // vehicle speed target [rpm]
+  int32_t   z_int;          // integrator fixdt(1,32,16) [command]
+  int16_t   r_cruise;       // last cruise command [-1000, 1000]
+  uint16_t  r_fade;         // share of the cruise command fixdt(0,16,15)
+  int16_t   r_out;          // command output [-1000, 1000]
+  uint8_t   b_ena;          // cruise control engaged
+} CruisePI;
+int16_t cruisePIStep(int16_t cmd, int16_t n, uint8_t b_spdMode, int16_t n_max, CruisePI *x);
+
+// Torque Map Functions
+typedef struct {
+  int16_t   n[4];           // speed breakpoints [rpm]
+  uint8_t   r[4];           // torque factor at the breakpoints [%]
+  int16_t   dr_launch;      // launch rise rate fixdt(1,16,4) [command / step]
+  int16_t   n_launchEnd;    // launch control end speed [rpm]
+  int16_t   z_cmd;          // launch limited command fixdt(1,16,4)
+  uint8_t   b_launch;       // launch control active
+} TorqueMap;
+int16_t torqueMapStep(int16_t cmd, int16_t n, TorqueMap *x);
+
+// Hill Hold Functions
+typedef struct {
+  uint16_t  kp;             // position gain fixdt(0,16,8) [torque target / count]
+  uint16_t  kd;             // speed damping fixdt(0,16,8) [torque target / rpm]
+  int16_t   i_peak;         // maximum hold current fixdt(1,16,4)
+  int16_t   i_cont;         // continuous hold current fixdt(1,16,4)
+  uint16_t  t_peak;         // time at i_peak until the limit is i_cont [steps]
+  uint16_t  t_release;      // time to fade out the hold torque [steps]
+  int32_t   z_posHold;      // latched position [counts]
+  int64_t   z_i2t;          // used I2t budget [(A2BIT)^2 * steps]
+  uint16_t  r_fade;         // hold torque factor fixdt(0,16,15)
+  int16_t   r_trq;          // hold torque target [-1000, 1000]
+  uint8_t   b_acv;          // hold active (latched or fading out)
+} HillHold;
+void hillHoldStep(int32_t pos, int16_t n, int16_t i_max, uint8_t b_req, HillHold *x);
+
 #endif
 
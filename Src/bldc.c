@@ -44,11 +44,20 @@ extern P    rtP_Left;
 extern DW   rtDW_Right;                 /* Observable states */
 extern ExtU rtU_Right;                  /* External inputs */
 extern ExtY rtY_Right;                  /* External outputs */
+extern P    rtP_Right;
 // ###############################################################################
 
 static int16_t pwm_margin;              /* This margin allows to have a window in the PWM signal for proper FOC Phase currents measurement */
 
 extern uint8_t ctrlModReq;
+#if defined(POSITION_CONTROL) || defined(HILL_HOLD_ENABLE)
+extern PosCtrl  posCtrlLeft;
+extern PosCtrl  posCtrlRight;
+#endif
+#ifdef POSITION_CONTROL
+extern uint8_t  ctrlModReqRaw;
+extern uint16_t posKp;
+#endif
 static int16_t curDC_max = (I_DC_MAX * A2BIT_CONV);
 int16_t curL_phaA = 0, curL_phaB = 0, curL_DC = 0;
 int16_t curR_phaB = 0, curR_phaC = 0, curR_DC = 0;
@@ -78,9 +87,84 @@ static int16_t offsetrrC    = 2000;
 static int16_t offsetdcl    = 2000;
 static int16_t offsetdcr    = 2000;
 
+#ifdef ENCODER_LEFT
+static EncoderAngle encLeft   = {0, -1, 0, 0};
+#endif
+#ifdef ENCODER_RIGHT
+static EncoderAngle encRight  = {0, -1, 0, 0};
+#endif
+#ifdef SCURVE_ENABLE
+SCurve sCurveLeft             = {SCURVE_VEL_MAX, SCURVE_ACC_MAX, SCURVE_JERK_MAX, 0, 0};
+SCurve sCurveRight            = {SCURVE_VEL_MAX, SCURVE_ACC_MAX, SCURVE_JERK_MAX, 0, 0};
+#endif
+#ifdef HALL_CALIB_ENABLE
+extern HallCalib hallCalibLeft;
+extern HallCalib hallCalibRight;
+volatile uint8_t hallCalibMot   = 0;    // motor in hall calibration: 0 = none, 1 = left, 2 = right
+volatile uint8_t hallCalibIdx   = 0;    // voltage vector angle index [0, 179] in 2 deg steps
+volatile int16_t hallCalibVolt  = 0;    // voltage vector amplitude
+#endif
+#ifdef RIPPLE_COMP_ENABLE
+extern RippleComp rippleLeft;
+extern RippleComp rippleRight;
+extern uint16_t   rippleGain;
+volatile uint8_t  rippleLearnEna = 0;   // accumulate iq per angle for the ripple learning
+#endif
+#ifdef SYNC_CTRL_ENABLE
+SyncCtrl syncCtrl             = {0, 0, 0, 0, SYNC_KP, SYNC_KI, SYNC_CORR_MAX};
+#endif
+#if defined(POSITION_CONTROL) || defined(SCURVE_ENABLE) || defined(SYNC_CTRL_ENABLE) || defined(TRACTION_CTRL) || defined(REGEN_LIMIT_ENABLE) || defined(BAT_LIMIT_ENABLE) || \
+    defined(BUMPLESS_ENABLE) || defined(HILL_HOLD_ENABLE) || defined(ABS_BRAKE_ENABLE)
+  #define INP_TGT_1KHZ                  // the input targets are processed at 1 kHz
+#endif
+#if defined(REGEN_LIMIT_ENABLE) || defined(BAT_LIMIT_ENABLE)
+static int32_t curDC_sum      = 0;      // sum of the DC link currents of both motors over 1 ms, positive = into the battery
+static uint8_t curDC_cnt      = 0;
+#endif
+#ifdef HILL_HOLD_ENABLE
+HillHold hillHoldLeft         = {HILL_HOLD_KP, HILL_HOLD_KD, HILL_HOLD_I_MAX * A2BIT_CONV << 4, HILL_HOLD_I_CONT * A2BIT_CONV << 4,
+                                 HILL_HOLD_T_MAX, HILL_HOLD_RELEASE, 0, 0, 0, 0, 0};
+HillHold hillHoldRight        = {HILL_HOLD_KP, HILL_HOLD_KD, HILL_HOLD_I_MAX * A2BIT_CONV << 4, HILL_HOLD_I_CONT * A2BIT_CONV << 4,
+                                 HILL_HOLD_T_MAX, HILL_HOLD_RELEASE, 0, 0, 0, 0, 0};
+volatile uint8_t hillHoldReq  = 0;      // hill hold request from standstillHold()
+#endif
+#ifdef TRACTION_CTRL
+TractionCtrl tractionLeft     = {TRC_ACC_MAX, TRC_DN_MAX, TRC_DEC, TRC_INC, 0, 0, 32768, 0};
+TractionCtrl tractionRight    = {TRC_ACC_MAX, TRC_DN_MAX, TRC_DEC, TRC_INC, 0, 0, 32768, 0};
+#endif
+#ifdef ABS_BRAKE_ENABLE
+AbsBrake absLeft              = {ABS_DEC_MAX, ABS_DN_MAX, ABS_N_MIN, ABS_DEC, ABS_INC, 0, 0, 32768, 0};
+AbsBrake absRight             = {ABS_DEC_MAX, ABS_DN_MAX, ABS_N_MIN, ABS_DEC, ABS_INC, 0, 0, 32768, 0};
+#endif
+#ifdef REGEN_LIMIT_ENABLE
+RegenLim regenLim             = {REGEN_I_MAX * A2BIT_CONV, REGEN_V_START, REGEN_V_STOP, 0, 32768, 32768};
+#endif
+#ifdef BAT_LIMIT_ENABLE
+BatLim   batLim               = {BAT_I_CONT * A2BIT_CONV, BAT_I_PEAK * A2BIT_CONV, BAT_T_PEAK, 0, 0, BAT_I_PEAK * A2BIT_CONV, 32768};
+#endif
+#ifdef BUMPLESS_ENABLE
+Bumpless bumplessLeft   = {BUMPLESS_TIME, OPEN_MODE, CTRL_TYP_SEL, 0, 0};
+Bumpless bumplessRight  = {BUMPLESS_TIME, OPEN_MODE, CTRL_TYP_SEL, 0, 0};
+#endif
+#ifdef INP_TGT_1KHZ
+static int16_t inpTgtL        = 0;      // input target at 1 kHz
+static int16_t inpTgtR        = 0;
+#endif
+
 int16_t        batVoltage       = (400 * BAT_CELLS * BAT_CALIB_ADC) / BAT_CALIB_REAL_VOLTAGE;
 static int32_t batVoltageFixdt  = (400 * BAT_CELLS * BAT_CALIB_ADC) / BAT_CALIB_REAL_VOLTAGE << 16;  // Fixed-point filter output initialized at 400 V*100/cell = 4 V/cell converted to fixed-point
 
+#ifdef HALL_CALIB_ENABLE
+// Open loop voltage vector for the hall calibration: inverse Park (at hallCalibIdx) and inverse Clarke, like the FOC output
+static void hallCalibPhaVolt(int *u, int *v, int *w) {
+  int16_t vAlpha = (int16_t)((hallCalibVolt * rtConstP.r_cos_M1_Table[hallCalibIdx]) >> 14);
+  int16_t vBeta  = (int16_t)((hallCalibVolt * rtConstP.r_sin_M1_Table[hallCalibIdx]) >> 14);
+  *u = vAlpha;
+  *v = -(vAlpha >> 1) + ((vBeta * 14189) >> 14);        // 14189 = sqrt(3)/2 * 2^14
+  *w = -*u - *v;
+}
+#endif
+
 // =================================
 // DMA interrupt frequency =~ 16 kHz
 // =================================
@@ -168,34 +252,177 @@ void DMA1_Channel1_IRQHandler(void) {
 
   /* Make sure to stop BOTH motors in case of an error */
   enableFin = enable && !rtY_Left.z_errCode && !rtY_Right.z_errCode;
+  #ifdef HALL_CALIB_ENABLE
+  enableFin = enableFin && !hallCalibMot;   // controllers stay disabled during the hall calibration
+  #endif
+
+  #if defined(REGEN_LIMIT_ENABLE) || defined(BAT_LIMIT_ENABLE)
+  curDC_sum += curL_DC + curR_DC;
+  curDC_cnt++;
+  #endif
+
+  #ifdef INP_TGT_1KHZ
+  // Input targets at 1 kHz
+  if (buzzerTimer % (PWM_FREQ / 1000) == 0) {
+    inpTgtL = (int16_t)pwml;
+    inpTgtR = (int16_t)pwmr;
+
+    #ifdef POSITION_CONTROL
+    // Position loop: replaces the input target with the speed command
+    uint8_t b_posEna = enableFin && ctrlModReqRaw == POS_MODE && ctrlModReq == SPD_MODE;
+    posCtrlStep(posKp, b_posEna, &posCtrlLeft);
+    posCtrlStep(posKp, b_posEna, &posCtrlRight);
+    if (b_posEna) {
+      inpTgtL = posCtrlLeft.r_spdCmd;
+      inpTgtR = posCtrlRight.r_spdCmd;
+    }
+    #endif
+
+    #ifdef SCURVE_ENABLE
+    // S-curve trajectory: restart from 0 when the motors are disabled
+    if (enableFin && ctrlModReq != OPEN_MODE) {
+      inpTgtL = sCurveStep(inpTgtL, &sCurveLeft);
+      inpTgtR = sCurveStep(inpTgtR, &sCurveRight);
+    } else {
+      sCurveLeft.y  = sCurveLeft.a  = 0;
+      sCurveRight.y = sCurveRight.a = 0;
+    }
+    #endif
+
+    #ifdef SYNC_CTRL_ENABLE
+    // Wheel synchronisation: correct both targets in SPEED mode
+    uint8_t b_syncEna = enableFin && ctrlModReq == SPD_MODE;
+    #ifdef POSITION_CONTROL
+    b_syncEna = b_syncEna && !b_posEna;
+    #endif
+    syncCtrlStep(inpTgtL, inpTgtR, rtY_Left.n_mot, rtY_Right.n_mot, rtP_Left.n_max, b_syncEna, &syncCtrl);
+    inpTgtL = (int16_t)CLAMP(inpTgtL + syncCtrl.r_corrL, -1000, 1000);
+    inpTgtR = (int16_t)CLAMP(inpTgtR + syncCtrl.r_corrR, -1000, 1000);
+    #endif
+
+    #ifdef TRACTION_CTRL
+    // Traction control: reduce the torque target of a slipping wheel
+    uint8_t b_trcEna = enableFin && ctrlModReq == TRQ_MODE;
+    inpTgtL = tractionCtrlStep(inpTgtL, rtY_Left.n_mot,  rtY_Right.n_mot, b_trcEna, &tractionLeft);
+    inpTgtR = tractionCtrlStep(inpTgtR, rtY_Right.n_mot, rtY_Left.n_mot,  b_trcEna, &tractionRight);
+    #endif
+
+    #ifdef ABS_BRAKE_ENABLE
+    // Anti-lock brake: reduce the braking part of the target of a locking wheel
+    uint8_t b_absEna = enableFin && (ctrlModReq == TRQ_MODE || ctrlModReq == SPD_MODE);
+    #if defined(INVERT_L_DIRECTION) == defined(INVERT_R_DIRECTION)
+    int8_t  s_mount  = -1;                  // motors mounted mirrored: the same motion is opposite rotations
+    #else
+    int8_t  s_mount  = 1;
+    #endif
+    inpTgtL = absBrakeStep(inpTgtL, rtY_Left.n_mot,  s_mount * rtY_Right.n_mot, rtP_Left.n_max,  ctrlModReq, b_absEna, &absLeft);
+    inpTgtR = absBrakeStep(inpTgtR, rtY_Right.n_mot, s_mount * rtY_Left.n_mot,  rtP_Right.n_max, ctrlModReq, b_absEna, &absRight);
+    #endif
+
+    #ifdef HILL_HOLD_ENABLE
+    // Hill hold: add the torque holding the latched wheel positions
+    uint8_t b_holdReq = hillHoldReq && enableFin && ctrlModReq == TRQ_MODE;
+    hillHoldStep(posCtrlLeft.z_pos,  rtY_Left.n_mot,  rtP_Left.i_max,  b_holdReq, &hillHoldLeft);
+    hillHoldStep(posCtrlRight.z_pos, rtY_Right.n_mot, rtP_Right.i_max, b_holdReq, &hillHoldRight);
+    inpTgtL = (int16_t)CLAMP(inpTgtL + hillHoldLeft.r_trq,  -1000, 1000);
+    inpTgtR = (int16_t)CLAMP(inpTgtR + hillHoldRight.r_trq, -1000, 1000);
+    #endif
+
+    #if defined(REGEN_LIMIT_ENABLE) || defined(BAT_LIMIT_ENABLE)
+    int16_t curDC_avg = (int16_t)(curDC_sum / MAX(curDC_cnt, 1));
+    curDC_sum = 0;
+    curDC_cnt = 0;
+    #endif
+
+    #ifdef REGEN_LIMIT_ENABLE
+    // Regen limits: fold back the braking part of the targets
+    regenLimStep(curDC_avg, batVoltage, &regenLim);
+    inpTgtL = dcLimApply(inpTgtL, rtY_Left.n_mot,  rtP_Left.n_max,  ctrlModReq, regenLim.r_fac, 1);
+    inpTgtR = dcLimApply(inpTgtR, rtY_Right.n_mot, rtP_Right.n_max, ctrlModReq, regenLim.r_fac, 1);
+    #endif
+
+    #ifdef BAT_LIMIT_ENABLE
+    // Battery current limit: fold back the driving part of both targets
+    batLimStep(curDC_avg, &batLim);
+    inpTgtL = dcLimApply(inpTgtL, rtY_Left.n_mot,  rtP_Left.n_max,  ctrlModReq, batLim.r_fac, 0);
+    inpTgtR = dcLimApply(inpTgtR, rtY_Right.n_mot, rtP_Right.n_max, ctrlModReq, batLim.r_fac, 0);
+    #endif
+
+    #ifdef BUMPLESS_ENABLE
+    // Bumpless transfer: start a new control mode or type at the present operating point
+    int16_t tgtOpL = bumplessOpTgt(ctrlModReq, rtP_Left.z_ctrlTypSel, rtY_Left.n_mot, rtY_Left.iq, rtDW_Left.UnitDelay4_DSTATE_eu,
+                                   rtP_Left.n_max, rtP_Left.i_max, rtP_Left.Vd_max);
+    int16_t tgtOpR = bumplessOpTgt(ctrlModReq, rtP_Right.z_ctrlTypSel, rtY_Right.n_mot, rtY_Right.iq, rtDW_Right.UnitDelay4_DSTATE_eu,
+                                   rtP_Right.n_max, rtP_Right.i_max, rtP_Right.Vd_max);
+    inpTgtL = bumplessStep(inpTgtL, tgtOpL, ctrlModReq, rtP_Left.z_ctrlTypSel,  enableFin, &bumplessLeft);
+    inpTgtR = bumplessStep(inpTgtR, tgtOpR, ctrlModReq, rtP_Right.z_ctrlTypSel, enableFin, &bumplessRight);
+    #endif
+  }
+  #endif
  
   // ========================= LEFT MOTOR ============================ 
     // Get hall sensors values
     uint8_t hall_ul = !(LEFT_HALL_U_PORT->IDR & LEFT_HALL_U_PIN);
     uint8_t hall_vl = !(LEFT_HALL_V_PORT->IDR & LEFT_HALL_V_PIN);
     uint8_t hall_wl = !(LEFT_HALL_W_PORT->IDR & LEFT_HALL_W_PIN);
+    #ifdef HALL_CALIB_ENABLE
+    uint8_t hall_l = hallCalibLeft.z_map[(hall_ul << 2) + (hall_vl << 1) + hall_wl];   // calibrated hall order
+    hall_ul = (hall_l >> 2) & 1;
+    hall_vl = (hall_l >> 1) & 1;
+    hall_wl =  hall_l       & 1;
+    #endif
 
     /* Set motor inputs here */
     rtU_Left.b_motEna     = enableFin;
     rtU_Left.z_ctrlModReq = ctrlModReq;  
+    #ifdef INP_TGT_1KHZ
+    rtU_Left.r_inpTgt     = inpTgtL;
+    #else
     rtU_Left.r_inpTgt     = pwml;
+    #endif
+    #ifdef RIPPLE_COMP_ENABLE
+    if (ctrlModReq == TRQ_MODE && rippleGain) {     // feedforward on the q-current reference at the last angle
+      rtU_Left.r_inpTgt += (int16_t)(rippleCompCalc(rtY_Left.a_elecAngle, &rippleLeft) * rippleGain / 100);
+    }
+    #endif
     rtU_Left.b_hallA      = hall_ul;
     rtU_Left.b_hallB      = hall_vl;
     rtU_Left.b_hallC      = hall_wl;
     rtU_Left.i_phaAB      = curL_phaA;
     rtU_Left.i_phaBC      = curL_phaB;
     rtU_Left.i_DCLink     = curL_DC;
-    // rtU_Left.a_mechAngle   = ...; // Angle input in DEGREES [0,360] in fixdt(1,16,4) data type. If `angle` is float use `= (int16_t)floor(angle * 16.0F)` If `angle` is integer use `= (int16_t)(angle << 4)`
+    #ifdef ENCODER_LEFT
+    #ifdef HALL_CALIB_ENABLE
+    encLeft.a_hallOffset  = hallCalibLeft.a_offset;
+    #endif
+    rtU_Left.a_mechAngle  = encoderAngleCalc((uint16_t)LEFT_ENC_TIM->CNT, hall_ul, hall_vl, hall_wl, rtP_Left.n_polePairs, &encLeft); // Angle input in DEGREES [0,360] in fixdt(1,16,4) data type
+    rtP_Left.b_angleMeasEna = encLeft.b_aligned;
+    #endif
+    #if (defined(POSITION_CONTROL) || defined(HILL_HOLD_ENABLE)) && defined(ENCODER_LEFT)
+    posCountEnc((uint16_t)LEFT_ENC_TIM->CNT, &posCtrlLeft);
+    #elif defined(POSITION_CONTROL) || defined(HILL_HOLD_ENABLE)
+    posCountHall(hall_ul, hall_vl, hall_wl, &posCtrlLeft);
+    #endif
     
     /* Step the controller */
     #ifdef MOTOR_LEFT_ENA    
     BLDC_controller_step(rtM_Left);
+    #ifdef RIPPLE_COMP_ENABLE
+    if (rippleLearnEna) {
+      rippleLearnStep(rtY_Left.a_elecAngle, rtY_Left.iq, &rippleLeft);
+    }
+    #endif
     #endif
 
     /* Get motor outputs here */
     ul            = rtY_Left.DC_phaA;
     vl            = rtY_Left.DC_phaB;
     wl            = rtY_Left.DC_phaC;
+    #ifdef HALL_CALIB_ENABLE
+    if (hallCalibMot == 1) {
+      hallCalibPhaVolt(&ul, &vl, &wl);
+    }
+    #endif
   // errCodeLeft  = rtY_Left.z_errCode;
   // motSpeedLeft = rtY_Left.n_mot;
   // motAngleLeft = rtY_Left.a_elecAngle;
@@ -212,28 +439,64 @@ void DMA1_Channel1_IRQHandler(void) {
     uint8_t hall_ur = !(RIGHT_HALL_U_PORT->IDR & RIGHT_HALL_U_PIN);
     uint8_t hall_vr = !(RIGHT_HALL_V_PORT->IDR & RIGHT_HALL_V_PIN);
     uint8_t hall_wr = !(RIGHT_HALL_W_PORT->IDR & RIGHT_HALL_W_PIN);
+    #ifdef HALL_CALIB_ENABLE
+    uint8_t hall_r = hallCalibRight.z_map[(hall_ur << 2) + (hall_vr << 1) + hall_wr];   // calibrated hall order
+    hall_ur = (hall_r >> 2) & 1;
+    hall_vr = (hall_r >> 1) & 1;
+    hall_wr =  hall_r       & 1;
+    #endif
 
     /* Set motor inputs here */
     rtU_Right.b_motEna      = enableFin;
     rtU_Right.z_ctrlModReq  = ctrlModReq;
+    #ifdef INP_TGT_1KHZ
+    rtU_Right.r_inpTgt      = inpTgtR;
+    #else
     rtU_Right.r_inpTgt      = pwmr;
+    #endif
+    #ifdef RIPPLE_COMP_ENABLE
+    if (ctrlModReq == TRQ_MODE && rippleGain) {     // feedforward on the q-current reference at the last angle
+      rtU_Right.r_inpTgt += (int16_t)(rippleCompCalc(rtY_Right.a_elecAngle, &rippleRight) * rippleGain / 100);
+    }
+    #endif
     rtU_Right.b_hallA       = hall_ur;
     rtU_Right.b_hallB       = hall_vr;
     rtU_Right.b_hallC       = hall_wr;
     rtU_Right.i_phaAB       = curR_phaB;
     rtU_Right.i_phaBC       = curR_phaC;
     rtU_Right.i_DCLink      = curR_DC;
-    // rtU_Right.a_mechAngle   = ...; // Angle input in DEGREES [0,360] in fixdt(1,16,4) data type. If `angle` is float use `= (int16_t)floor(angle * 16.0F)` If `angle` is integer use `= (int16_t)(angle << 4)`
+    #ifdef ENCODER_RIGHT
+    #ifdef HALL_CALIB_ENABLE
+    encRight.a_hallOffset = hallCalibRight.a_offset;
+    #endif
+    rtU_Right.a_mechAngle = encoderAngleCalc((uint16_t)RIGHT_ENC_TIM->CNT, hall_ur, hall_vr, hall_wr, rtP_Right.n_polePairs, &encRight); // Angle input in DEGREES [0,360] in fixdt(1,16,4) data type
+    rtP_Right.b_angleMeasEna = encRight.b_aligned;
+    #endif
+    #if (defined(POSITION_CONTROL) || defined(HILL_HOLD_ENABLE)) && defined(ENCODER_RIGHT)
+    posCountEnc((uint16_t)RIGHT_ENC_TIM->CNT, &posCtrlRight);
+    #elif defined(POSITION_CONTROL) || defined(HILL_HOLD_ENABLE)
+    posCountHall(hall_ur, hall_vr, hall_wr, &posCtrlRight);
+    #endif
     
     /* Step the controller */
     #ifdef MOTOR_RIGHT_ENA
     BLDC_controller_step(rtM_Right);
+    #ifdef RIPPLE_COMP_ENABLE
+    if (rippleLearnEna) {
+      rippleLearnStep(rtY_Right.a_elecAngle, rtY_Right.iq, &rippleRight);
+    }
+    #endif
     #endif
 
     /* Get motor outputs here */
     ur            = rtY_Right.DC_phaA;
     vr            = rtY_Right.DC_phaB;
     wr            = rtY_Right.DC_phaC;
+    #ifdef HALL_CALIB_ENABLE
+    if (hallCalibMot == 2) {
+      hallCalibPhaVolt(&ur, &vr, &wr);
+    }
+    #endif
  // errCodeRight  = rtY_Right.z_errCode;
  // motSpeedRight = rtY_Right.n_mot;
  // motAngleRight = rtY_Right.a_elecAngle;
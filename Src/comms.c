@@ -18,7 +18,6 @@
 */
 
 // Includes
-#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include "stm32f1xx_hal.h"
@@ -28,6 +27,7 @@
 #include "BLDC_controller.h"
 #include "util.h"
 #include "comms.h"
+#include "format.h"
 
 #if defined(DEBUG_SERIAL_PROTOCOL)
 #if defined(DEBUG_SERIAL_PROTOCOL) && (defined(DEBUG_SERIAL_USART2) || defined(DEBUG_SERIAL_USART3))
@@ -66,6 +66,78 @@ extern int16_t right_dc_curr;
 extern int16_t dc_curr;
 extern int16_t cmdL; 
 extern int16_t cmdR; 
+#ifdef GAIN_SCHED_ENABLE
+extern GainSched gainSched;
+#endif
+#ifdef STEER_SCHED_ENABLE
+extern SteerSched steerSched;
+#endif
+#ifdef BIQUAD_ENABLE
+extern Biquad biquadSpeed;
+extern Biquad biquadSteer;
+#endif
+#ifdef HALL_CALIB_ENABLE
+extern HallCalib hallCalibLeft;
+extern HallCalib hallCalibRight;
+#endif
+#ifdef RIPPLE_COMP_ENABLE
+extern uint16_t rippleGain;
+#endif
+#ifdef MOT_THERM_ENABLE
+extern MotTherm  motThermLeft;
+extern MotTherm  motThermRight;
+#endif
+#ifdef LIM_DERATE
+extern LimDerate iMaxDerLeft;
+extern LimDerate iMaxDerRight;
+#endif
+#if TEMP_DERATE_ENABLE && TEMP_DERATE_SPEED
+extern LimDerate nMaxDerLeft;
+extern LimDerate nMaxDerRight;
+#endif
+#if TEMP_DERATE_ENABLE
+extern uint16_t  tempDerate;
+#endif
+#ifdef REGEN_LIMIT_ENABLE
+extern RegenLim regenLim;
+#endif
+#ifdef BAT_LIMIT_ENABLE
+extern BatLim   batLim;
+#endif
+#ifdef BUMPLESS_ENABLE
+extern Bumpless bumplessLeft;
+extern Bumpless bumplessRight;
+#endif
+#ifdef CRUISE_PI_ENABLE
+extern CruisePI cruisePI;
+#endif
+#ifdef HILL_HOLD_ENABLE
+extern HillHold hillHoldLeft;
+extern HillHold hillHoldRight;
+#endif
+#ifdef TRACTION_CTRL
+extern TractionCtrl tractionLeft;
+extern TractionCtrl tractionRight;
+#endif
+#ifdef ABS_BRAKE_ENABLE
+extern AbsBrake absLeft;
+extern AbsBrake absRight;
+#endif
+#ifdef SYNC_CTRL_ENABLE
+extern SyncCtrl syncCtrl;
+#endif
+#ifdef SCURVE_ENABLE
+extern SCurve   sCurveLeft;
+extern SCurve   sCurveRight;
+#endif
+#ifdef POSITION_CONTROL
+extern PosCtrl  posCtrlLeft;
+extern PosCtrl  posCtrlRight;
+extern uint16_t posKp;
+  #define CTRL_MOD_MAX  POS_MODE
+#else
+  #define CTRL_MOD_MAX  TRQ_MODE
+#endif
 
 
 
@@ -81,21 +153,116 @@ const command_entry commands[] = {
     {WRITE  ,"SET"     ,NULL              ,NULL            ,setParamValExt ,"Set Parameter"},
     {WRITE  ,"INIT"    ,NULL              ,initParamVal    ,NULL           ,"Init Parameter from EEPROM or CONFIG.H"},
     {WRITE  ,"SAVE"    ,saveAllParamVal   ,NULL            ,NULL           ,"Save Parameters to EEPROM"},
+#ifdef HALL_CALIB_ENABLE
+    {WRITE  ,"HALLCAL" ,hallCalib         ,NULL            ,NULL           ,"Calibrate hall order and offset (wheels lifted)"},
+#endif
+#ifdef RIPPLE_COMP_ENABLE
+    {WRITE  ,"RIPLEARN",rippleLearn       ,NULL            ,NULL           ,"Learn ripple compensation (wheels lifted)"},
+#endif
 };
 
 enum paramTypes {PARAMETER,VARIABLE};
 const parameter_entry params[] = {
   // CONTROL PARAMETERS
   // Type       ,Name                 ,Datatype ,ValueL ptr                  ,ValueR                    ,EEPRM Addr ,Init              Int/Ext ,Min    ,Max    ,Div             ,Mul  ,Fix   ,Callback Function  ,Help text
-    {PARAMETER  ,"CTRL_MOD"           ,ADD_PARAM(ctrlModReqRaw)              ,NULL                      ,0          ,CTRL_MOD_REQ      ,0      ,1      ,3      ,0               ,0    ,0     ,NULL               ,"Ctrl mode 1:VLT 2:SPD 3:TRQ"},
+    {PARAMETER  ,"CTRL_MOD"           ,ADD_PARAM(ctrlModReqRaw)              ,NULL                      ,0          ,CTRL_MOD_REQ      ,0      ,1      ,CTRL_MOD_MAX,0          ,0    ,0     ,NULL               ,"Ctrl mode 1:VLT 2:SPD 3:TRQ 4:POS"},
     {PARAMETER  ,"CTRL_TYP"           ,ADD_PARAM(rtP_Left.z_ctrlTypSel)      ,&rtP_Right.z_ctrlTypSel   ,0          ,CTRL_TYP_SEL      ,0      ,0      ,2      ,0               ,0    ,0     ,NULL               ,"Ctrl type 0:COM 1:SIN 2:FOC"},
+#ifdef LIM_DERATE
+    {PARAMETER  ,"I_MOT_MAX"          ,ADD_PARAM(iMaxDerLeft.x_nom)          ,&iMaxDerRight.x_nom       ,1          ,I_MOT_MAX         ,1      ,1      ,40     ,A2BIT_CONV      ,0    ,4     ,NULL               ,"Max phase current A"},
+#else
     {PARAMETER  ,"I_MOT_MAX"          ,ADD_PARAM(rtP_Left.i_max)             ,&rtP_Right.i_max          ,1          ,I_MOT_MAX         ,1      ,1      ,40     ,A2BIT_CONV      ,0    ,4     ,NULL               ,"Max phase current A"},
+#endif
+#if TEMP_DERATE_ENABLE && TEMP_DERATE_SPEED
+    {PARAMETER  ,"N_MOT_MAX"          ,ADD_PARAM(nMaxDerLeft.x_nom)          ,&nMaxDerRight.x_nom       ,2          ,N_MOT_MAX         ,1      ,10     ,2000   ,0               ,0    ,4     ,NULL               ,"Max motor RPM"},
+#else
     {PARAMETER  ,"N_MOT_MAX"          ,ADD_PARAM(rtP_Left.n_max)             ,&rtP_Right.n_max          ,2          ,N_MOT_MAX         ,1      ,10     ,2000   ,0               ,0    ,4     ,NULL               ,"Max motor RPM"},
+#endif
     {PARAMETER  ,"FI_WEAK_ENA"        ,ADD_PARAM(rtP_Left.b_fieldWeakEna)    ,&rtP_Right.b_fieldWeakEna ,0          ,FIELD_WEAK_ENA    ,0      ,0      ,1      ,0               ,0    ,0     ,NULL               ,"Enable field weak"},
   	{PARAMETER  ,"FI_WEAK_HI"         ,ADD_PARAM(rtP_Left.r_fieldWeakHi)     ,&rtP_Right.r_fieldWeakHi  ,0          ,FIELD_WEAK_HI     ,1      ,0      ,1500   ,0               ,0    ,4     ,Input_Lim_Init     ,"Field weak high RPM"},
 	  {PARAMETER  ,"FI_WEAK_LO"         ,ADD_PARAM(rtP_Left.r_fieldWeakLo)     ,&rtP_Right.r_fieldWeakLo  ,0          ,FIELD_WEAK_LO     ,1      ,0      ,1000   ,0               ,0    ,4     ,Input_Lim_Init     ,"Field weak low RPM"},
     {PARAMETER  ,"FI_WEAK_MAX"        ,ADD_PARAM(rtP_Left.id_fieldWeakMax)   ,&rtP_Right.id_fieldWeakMax,0          ,FIELD_WEAK_MAX    ,1      ,0      ,20     ,A2BIT_CONV      ,0    ,4     ,NULL               ,"Field weak max current A(FOC)"},
     {PARAMETER  ,"PHA_ADV_MAX"        ,ADD_PARAM(rtP_Left.a_phaAdvMax)       ,&rtP_Right.a_phaAdvMax    ,0          ,PHASE_ADV_MAX     ,1      ,0      ,55     ,0               ,0    ,4     ,NULL               ,"Max Phase Adv angle Deg(SIN)"},     
+#ifdef GAIN_SCHED_ENABLE
+    {PARAMETER  ,"GS_N1"              ,ADD_PARAM(gainSched.n[0])             ,NULL                      ,19         ,GAIN_SCHED_N1     ,0      ,0      ,2000   ,0               ,0    ,0     ,NULL               ,"Gain sched speed 1 RPM"},
+    {PARAMETER  ,"GS_N2"              ,ADD_PARAM(gainSched.n[1])             ,NULL                      ,20         ,GAIN_SCHED_N2     ,0      ,0      ,2000   ,0               ,0    ,0     ,NULL               ,"Gain sched speed 2 RPM"},
+    {PARAMETER  ,"GS_N3"              ,ADD_PARAM(gainSched.n[2])             ,NULL                      ,21         ,GAIN_SCHED_N3     ,0      ,0      ,2000   ,0               ,0    ,0     ,NULL               ,"Gain sched speed 3 RPM"},
+    {PARAMETER  ,"GS_KP1"             ,ADD_PARAM(gainSched.kp[0])            ,NULL                      ,22         ,GAIN_SCHED_KP1    ,0      ,0      ,32767  ,0               ,0    ,0     ,NULL               ,"Gain sched Kp 1 fixdt(0,16,12)"},
+    {PARAMETER  ,"GS_KP2"             ,ADD_PARAM(gainSched.kp[1])            ,NULL                      ,23         ,GAIN_SCHED_KP2    ,0      ,0      ,32767  ,0               ,0    ,0     ,NULL               ,"Gain sched Kp 2 fixdt(0,16,12)"},
+    {PARAMETER  ,"GS_KP3"             ,ADD_PARAM(gainSched.kp[2])            ,NULL                      ,24         ,GAIN_SCHED_KP3    ,0      ,0      ,32767  ,0               ,0    ,0     ,NULL               ,"Gain sched Kp 3 fixdt(0,16,12)"},
+    {PARAMETER  ,"GS_KI1"             ,ADD_PARAM(gainSched.ki[0])            ,NULL                      ,25         ,GAIN_SCHED_KI1    ,0      ,0      ,32767  ,0               ,0    ,0     ,NULL               ,"Gain sched Ki 1 fixdt(0,16,16)"},
+    {PARAMETER  ,"GS_KI2"             ,ADD_PARAM(gainSched.ki[1])            ,NULL                      ,26         ,GAIN_SCHED_KI2    ,0      ,0      ,32767  ,0               ,0    ,0     ,NULL               ,"Gain sched Ki 2 fixdt(0,16,16)"},
+    {PARAMETER  ,"GS_KI3"             ,ADD_PARAM(gainSched.ki[2])            ,NULL                      ,27         ,GAIN_SCHED_KI3    ,0      ,0      ,32767  ,0               ,0    ,0     ,NULL               ,"Gain sched Ki 3 fixdt(0,16,16)"},
+#endif
+#ifdef STEER_SCHED_ENABLE
+    {PARAMETER  ,"SS_N1"              ,ADD_PARAM(steerSched.n[0])            ,NULL                      ,76         ,STEER_SCHED_N1    ,0      ,0      ,2000   ,0               ,0    ,0     ,NULL               ,"Steer sched speed 1 RPM"},
+    {PARAMETER  ,"SS_N2"              ,ADD_PARAM(steerSched.n[1])            ,NULL                      ,77         ,STEER_SCHED_N2    ,0      ,0      ,2000   ,0               ,0    ,0     ,NULL               ,"Steer sched speed 2 RPM"},
+    {PARAMETER  ,"SS_N3"              ,ADD_PARAM(steerSched.n[2])            ,NULL                      ,78         ,STEER_SCHED_N3    ,0      ,0      ,2000   ,0               ,0    ,0     ,NULL               ,"Steer sched speed 3 RPM"},
+    {PARAMETER  ,"SS_R1"              ,ADD_PARAM(steerSched.r[0])            ,NULL                      ,79         ,STEER_SCHED_R1    ,0      ,0      ,16384  ,0               ,0    ,0     ,NULL               ,"Steer sched factor 1 fixdt(0,16,14)"},
+    {PARAMETER  ,"SS_R2"              ,ADD_PARAM(steerSched.r[1])            ,NULL                      ,80         ,STEER_SCHED_R2    ,0      ,0      ,16384  ,0               ,0    ,0     ,NULL               ,"Steer sched factor 2 fixdt(0,16,14)"},
+    {PARAMETER  ,"SS_R3"              ,ADD_PARAM(steerSched.r[2])            ,NULL                      ,81         ,STEER_SCHED_R3    ,0      ,0      ,16384  ,0               ,0    ,0     ,NULL               ,"Steer sched factor 3 fixdt(0,16,14)"},
+#endif
+#ifdef BIQUAD_ENABLE
+    {PARAMETER  ,"BQ_SPD_TYP"         ,ADD_PARAM(biquadSpeed.typ)            ,NULL                      ,0          ,BIQUAD_SPD_TYP    ,0      ,0      ,1      ,0               ,0    ,0     ,Biquad_Init        ,"Speed filter 0:LPF 1:Notch"},
+    {PARAMETER  ,"BQ_SPD_FC"          ,ADD_PARAM(biquadSpeed.f_c)            ,NULL                      ,0          ,BIQUAD_SPD_FC     ,0      ,1      ,999    ,0               ,0    ,0     ,Biquad_Init        ,"Speed filter freq Hz*10"},
+    {PARAMETER  ,"BQ_SPD_Q"           ,ADD_PARAM(biquadSpeed.q)              ,NULL                      ,0          ,BIQUAD_SPD_Q      ,0      ,1      ,2560   ,0               ,0    ,0     ,Biquad_Init        ,"Speed filter Q fixdt(0,16,8)"},
+    {PARAMETER  ,"BQ_STR_TYP"         ,ADD_PARAM(biquadSteer.typ)            ,NULL                      ,0          ,BIQUAD_STR_TYP    ,0      ,0      ,1      ,0               ,0    ,0     ,Biquad_Init        ,"Steer filter 0:LPF 1:Notch"},
+    {PARAMETER  ,"BQ_STR_FC"          ,ADD_PARAM(biquadSteer.f_c)            ,NULL                      ,0          ,BIQUAD_STR_FC     ,0      ,1      ,999    ,0               ,0    ,0     ,Biquad_Init        ,"Steer filter freq Hz*10"},
+    {PARAMETER  ,"BQ_STR_Q"           ,ADD_PARAM(biquadSteer.q)              ,NULL                      ,0          ,BIQUAD_STR_Q      ,0      ,1      ,2560   ,0               ,0    ,0     ,Biquad_Init        ,"Steer filter Q fixdt(0,16,8)"},
+#endif
+#ifdef MOT_THERM_ENABLE
+    {PARAMETER  ,"MOT_I_CONT"         ,ADD_PARAM(motThermLeft.i_cont)        ,&motThermRight.i_cont     ,0          ,MOT_THERM_I_CONT  ,1      ,1      ,40     ,A2BIT_CONV      ,0    ,4     ,NULL               ,"Motor continuous current A"},
+    {PARAMETER  ,"MOT_TAU"            ,ADD_PARAM(motThermLeft.t_tau)         ,&motThermRight.t_tau      ,0          ,MOT_THERM_TAU     ,0      ,1      ,65535  ,0               ,0    ,0     ,NULL               ,"Motor thermal time constant s"},
+#endif
+#ifdef RIPPLE_COMP_ENABLE
+    {PARAMETER  ,"RIP_GAIN"           ,ADD_PARAM(rippleGain)                 ,NULL                      ,0          ,RIPPLE_COMP_GAIN  ,0      ,0      ,200    ,0               ,0    ,0     ,NULL               ,"Ripple compensation gain % (TRQ)"},
+#endif
+#ifdef SCURVE_ENABLE
+    {PARAMETER  ,"SC_VEL_MAX"         ,ADD_PARAM(sCurveLeft.velMax)          ,&sCurveRight.velMax       ,0          ,SCURVE_VEL_MAX    ,0      ,0      ,1000   ,0               ,0    ,0     ,NULL               ,"S-curve max target"},
+    {PARAMETER  ,"SC_ACC_MAX"         ,ADD_PARAM(sCurveLeft.accMax)          ,&sCurveRight.accMax       ,0          ,SCURVE_ACC_MAX    ,0      ,1      ,32767  ,0               ,0    ,0     ,NULL               ,"S-curve max slope /s"},
+    {PARAMETER  ,"SC_JERK_MAX"        ,ADD_PARAM(sCurveLeft.jerkMax)         ,&sCurveRight.jerkMax      ,0          ,SCURVE_JERK_MAX   ,0      ,1      ,32767  ,0               ,0    ,0     ,NULL               ,"S-curve max jerk /s^2"},
+#endif
+#ifdef SYNC_CTRL_ENABLE
+    {PARAMETER  ,"SYNC_KP"            ,ADD_PARAM(syncCtrl.kp)                ,NULL                      ,0          ,SYNC_KP           ,0      ,0      ,32767  ,0               ,0    ,0     ,NULL               ,"Wheel sync P gain fixdt(0,16,8)"},
+    {PARAMETER  ,"SYNC_KI"            ,ADD_PARAM(syncCtrl.ki)                ,NULL                      ,0          ,SYNC_KI           ,0      ,0      ,32767  ,0               ,0    ,0     ,NULL               ,"Wheel sync I gain fixdt(0,16,16)"},
+    {PARAMETER  ,"SYNC_CORR_MAX"      ,ADD_PARAM(syncCtrl.r_corrMax)         ,NULL                      ,0          ,SYNC_CORR_MAX     ,0      ,0      ,1000   ,0               ,0    ,0     ,NULL               ,"Wheel sync max correction"},
+#endif
+#ifdef REGEN_LIMIT_ENABLE
+    {PARAMETER  ,"REGEN_I_MAX"        ,ADD_PARAM(regenLim.i_max)             ,NULL                      ,0          ,REGEN_I_MAX       ,1      ,0      ,40     ,A2BIT_CONV      ,0    ,0     ,NULL               ,"Max regen DC current A"},
+#endif
+#ifdef BAT_LIMIT_ENABLE
+    {PARAMETER  ,"BAT_I_CONT"         ,ADD_PARAM(batLim.i_cont)              ,NULL                      ,0          ,BAT_I_CONT        ,1      ,1      ,60     ,A2BIT_CONV      ,0    ,0     ,NULL               ,"Continuous battery current A"},
+    {PARAMETER  ,"BAT_I_PEAK"         ,ADD_PARAM(batLim.i_peak)              ,NULL                      ,0          ,BAT_I_PEAK        ,1      ,1      ,60     ,A2BIT_CONV      ,0    ,0     ,NULL               ,"Peak battery current A"},
+    {PARAMETER  ,"BAT_T_PEAK"         ,ADD_PARAM(batLim.t_peak)              ,NULL                      ,0          ,BAT_T_PEAK        ,0      ,0      ,65535  ,0               ,0    ,0     ,NULL               ,"Peak battery current time ms"},
+#endif
+#ifdef BUMPLESS_ENABLE
+    {PARAMETER  ,"BUMP_TIME"          ,ADD_PARAM(bumplessLeft.t_decay)       ,&bumplessRight.t_decay    ,0          ,BUMPLESS_TIME     ,0      ,1      ,65535  ,0               ,0    ,0     ,NULL               ,"Bumpless transfer time ms"},
+#endif
+#ifdef CRUISE_PI_ENABLE
+    {PARAMETER  ,"CRUISE_KP"          ,ADD_PARAM(cruisePI.kp)                ,NULL                      ,0          ,CRUISE_KP         ,0      ,0      ,65535  ,0               ,0    ,0     ,NULL               ,"Cruise P gain fixdt(0,16,8)"},
+    {PARAMETER  ,"CRUISE_KI"          ,ADD_PARAM(cruisePI.ki)                ,NULL                      ,0          ,CRUISE_KI         ,0      ,0      ,65535  ,0               ,0    ,0     ,NULL               ,"Cruise I gain fixdt(0,16,8)"},
+    {PARAMETER  ,"CRUISE_REL"         ,ADD_PARAM(cruisePI.t_release)         ,NULL                      ,0          ,CRUISE_RELEASE    ,0      ,1      ,32767  ,0               ,0    ,0     ,NULL               ,"Cruise release time ms"},
+#endif
+#ifdef HILL_HOLD_ENABLE
+    {PARAMETER  ,"HOLD_KP"            ,ADD_PARAM(hillHoldLeft.kp)            ,&hillHoldRight.kp         ,0          ,HILL_HOLD_KP      ,0      ,0      ,65535  ,0               ,0    ,0     ,NULL               ,"Hill hold pos gain fixdt(0,16,8)"},
+    {PARAMETER  ,"HOLD_KD"            ,ADD_PARAM(hillHoldLeft.kd)            ,&hillHoldRight.kd         ,0          ,HILL_HOLD_KD      ,0      ,0      ,65535  ,0               ,0    ,0     ,NULL               ,"Hill hold damping fixdt(0,16,8)"},
+    {PARAMETER  ,"HOLD_I_MAX"         ,ADD_PARAM(hillHoldLeft.i_peak)        ,&hillHoldRight.i_peak     ,0          ,HILL_HOLD_I_MAX   ,1      ,1      ,40     ,A2BIT_CONV      ,0    ,4     ,NULL               ,"Hill hold max current A"},
+    {PARAMETER  ,"HOLD_I_CONT"        ,ADD_PARAM(hillHoldLeft.i_cont)        ,&hillHoldRight.i_cont     ,0          ,HILL_HOLD_I_CONT  ,1      ,1      ,40     ,A2BIT_CONV      ,0    ,4     ,NULL               ,"Hill hold continuous current A"},
+#endif
+#ifdef TRACTION_CTRL
+    {PARAMETER  ,"TRC_ACC_MAX"        ,ADD_PARAM(tractionLeft.a_max)         ,&tractionRight.a_max      ,0          ,TRC_ACC_MAX       ,0      ,100    ,32767  ,0               ,0    ,0     ,NULL               ,"Traction max accel rpm/s"},
+    {PARAMETER  ,"TRC_DN_MAX"         ,ADD_PARAM(tractionLeft.dn_max)        ,&tractionRight.dn_max     ,0          ,TRC_DN_MAX        ,0      ,0      ,2000   ,0               ,0    ,0     ,NULL               ,"Traction max speed diff RPM"},
+    {PARAMETER  ,"TRC_DEC"            ,ADD_PARAM(tractionLeft.r_dec)         ,&tractionRight.r_dec      ,0          ,TRC_DEC           ,0      ,1      ,32767  ,0               ,0    ,0     ,NULL               ,"Traction trq drop/ms fixdt(0,16,15)"},
+    {PARAMETER  ,"TRC_INC"            ,ADD_PARAM(tractionLeft.r_inc)         ,&tractionRight.r_inc      ,0          ,TRC_INC           ,0      ,1      ,32767  ,0               ,0    ,0     ,NULL               ,"Traction trq recovery/ms fixdt(0,16,15)"},
+#endif
+#ifdef ABS_BRAKE_ENABLE
+    {PARAMETER  ,"ABS_DEC_MAX"        ,ADD_PARAM(absLeft.a_max)              ,&absRight.a_max           ,0          ,ABS_DEC_MAX       ,0      ,100    ,32767  ,0               ,0    ,0     ,NULL               ,"ABS max decel rpm/s"},
+    {PARAMETER  ,"ABS_DN_MAX"         ,ADD_PARAM(absLeft.dn_max)             ,&absRight.dn_max          ,0          ,ABS_DN_MAX        ,0      ,0      ,2000   ,0               ,0    ,0     ,NULL               ,"ABS max speed diff RPM"},
+#endif
+#ifdef POSITION_CONTROL
+    {PARAMETER  ,"POS_KP"             ,ADD_PARAM(posKp)                      ,NULL                      ,0          ,POS_KP            ,0      ,0      ,32767  ,0               ,0    ,0     ,NULL               ,"Position gain fixdt(0,16,8)"},
+    {PARAMETER  ,"POS_TGTL"           ,ADD_PARAM(posCtrlLeft.z_posTgt)       ,NULL                      ,0          ,0                 ,0      ,-MAX_int32_T,MAX_int32_T,0               ,0    ,0     ,NULL               ,"Left position target counts"},
+    {PARAMETER  ,"POS_TGTR"           ,ADD_PARAM(posCtrlRight.z_posTgt)      ,NULL                      ,0          ,0                 ,0      ,-MAX_int32_T,MAX_int32_T,0               ,0    ,0     ,NULL               ,"Right position target counts"},
+#endif
   // INPUT PARAMETERS
   // Type       ,Name                 ,ValueL ptr                            ,ValueR                    ,EEPRM Addr ,Init              Int/Ext ,Min    ,Max    ,Div             ,Mul  ,Fix   ,Callback Function  ,Help text
     {VARIABLE   ,"IN1_RAW"            ,ADD_PARAM(input1[0].raw)              ,NULL                      ,0          ,0                 ,0      ,RAW_MIN,RAW_MAX,0               ,0    ,0     ,0                  ,"Input1 raw"},        
@@ -103,6 +270,9 @@ const parameter_entry params[] = {
     {PARAMETER  ,"IN1_MIN"            ,ADD_PARAM(input1[0].min)              ,NULL                      ,4          ,RAW_MIN           ,0      ,RAW_MIN,RAW_MAX,0               ,0    ,0     ,0                  ,"Input1 min"},        
     {PARAMETER  ,"IN1_MID"            ,ADD_PARAM(input1[0].mid)              ,NULL                      ,5          ,0                 ,0      ,RAW_MIN,RAW_MAX,0               ,0    ,0     ,0                  ,"Input1 mid"},
     {PARAMETER  ,"IN1_MAX"            ,ADD_PARAM(input1[0].max)              ,NULL                      ,6          ,RAW_MAX           ,0      ,RAW_MIN,RAW_MAX,0               ,0    ,0     ,0                  ,"Input1 max"},        
+#ifdef INPUT_CURVE_ENABLE
+    {PARAMETER  ,"IN1_EXPO"           ,ADD_PARAM(input1[0].expo)             ,NULL                      ,72         ,INPUT1_EXPO       ,0      ,0      ,100    ,0               ,0    ,0     ,0                  ,"Input1 expo %"},
+#endif
     {VARIABLE   ,"IN1_CMD"            ,ADD_PARAM(input1[0].cmd)              ,NULL                      ,0          ,0                 ,0      ,0      ,0      ,0               ,0    ,0     ,0                  ,"Input1 cmd"},        
     
     {VARIABLE   ,"IN2_RAW"            ,ADD_PARAM(input2[0].raw)              ,NULL                      ,0          ,0                 ,0      ,RAW_MIN,RAW_MAX,0               ,0    ,0     ,0                  ,"Input2 raw"},   
@@ -110,6 +280,9 @@ const parameter_entry params[] = {
     {PARAMETER  ,"IN2_MIN"            ,ADD_PARAM(input2[0].min)              ,NULL                      ,8          ,RAW_MIN           ,0      ,RAW_MIN,RAW_MAX,0               ,0    ,0     ,0                  ,"Input2 min"},        
     {PARAMETER  ,"IN2_MID"            ,ADD_PARAM(input2[0].mid)              ,NULL                      ,9          ,0                 ,0      ,RAW_MIN,RAW_MAX,0               ,0    ,0     ,0                  ,"Input2 mid"},
     {PARAMETER  ,"IN2_MAX"            ,ADD_PARAM(input2[0].max)              ,NULL                      ,10         ,RAW_MAX           ,0      ,RAW_MIN,RAW_MAX,0               ,0    ,0     ,0                  ,"Input2 max"},
+#ifdef INPUT_CURVE_ENABLE
+    {PARAMETER  ,"IN2_EXPO"           ,ADD_PARAM(input2[0].expo)             ,NULL                      ,73         ,INPUT2_EXPO       ,0      ,0      ,100    ,0               ,0    ,0     ,0                  ,"Input2 expo %"},
+#endif
     {VARIABLE   ,"IN2_CMD"            ,ADD_PARAM(input2[0].cmd)              ,NULL                      ,0          ,0                 ,0      ,0      ,0      ,0               ,0    ,0     ,0                  ,"Input2 cmd"},
 #if defined(PRI_INPUT1) && defined(PRI_INPUT2) && defined(AUX_INPUT1) && defined(AUX_INPUT2)  
   // Type       ,Name                 ,ValueL ptr                            ,ValueR                    ,EEPRM Addr ,Init              Int/Ext ,Min    ,Max    ,Div             ,Mul  ,Fix   ,Callback Function  ,Help text
@@ -118,6 +291,9 @@ const parameter_entry params[] = {
     {PARAMETER  ,"AUX_IN1_MIN"        ,ADD_PARAM(input1[1].min)              ,NULL                      ,12         ,RAW_MIN           ,0      ,RAW_MIN,RAW_MAX,0               ,0    ,0     ,0                  ,"Aux. input1 min"},        
     {PARAMETER  ,"AUX_IN1_MID"        ,ADD_PARAM(input1[1].mid)              ,NULL                      ,13         ,0                 ,0      ,RAW_MIN,RAW_MAX,0               ,0    ,0     ,0                  ,"Aux. input1 mid"},
     {PARAMETER  ,"AUX_IN1_MAX"        ,ADD_PARAM(input1[1].max)              ,NULL                      ,14         ,RAW_MAX           ,0      ,RAW_MIN,RAW_MAX,0               ,0    ,0     ,0                  ,"Aux. input1 max"},        
+#ifdef INPUT_CURVE_ENABLE
+    {PARAMETER  ,"AUX_IN1_EXPO"       ,ADD_PARAM(input1[1].expo)             ,NULL                      ,74         ,INPUT1_EXPO       ,0      ,0      ,100    ,0               ,0    ,0     ,0                  ,"Aux. input1 expo %"},
+#endif
     {VARIABLE   ,"AUX_IN1_CMD"        ,ADD_PARAM(input1[1].cmd)              ,NULL                      ,0          ,0                 ,0      ,0      ,0      ,0               ,0    ,0     ,0                  ,"Aux. input1 cmd"},        
     
     {VARIABLE   ,"AUX_IN2_RAW"        ,ADD_PARAM(input2[1].raw)              ,NULL                      ,0          ,0                 ,0      ,RAW_MIN,RAW_MAX,0               ,0    ,0     ,0                  ,"Aux. input2 raw"},        
@@ -125,6 +301,9 @@ const parameter_entry params[] = {
     {PARAMETER  ,"AUX_IN2_MIN"        ,ADD_PARAM(input2[1].min)              ,NULL                      ,16         ,RAW_MIN           ,0      ,RAW_MIN,RAW_MAX,0               ,0    ,0     ,0                  ,"Aux. input2 min"},        
     {PARAMETER  ,"AUX_IN2_MID"        ,ADD_PARAM(input2[1].mid)              ,NULL                      ,17         ,0                 ,0      ,RAW_MIN,RAW_MAX,0               ,0    ,0     ,0                  ,"Aux. input2 mid"},
     {PARAMETER  ,"AUX_IN2_MAX"        ,ADD_PARAM(input2[1].max)              ,NULL                      ,18         ,RAW_MAX           ,0      ,RAW_MIN,RAW_MAX,0               ,0    ,0     ,0                  ,"Aux. input2 max"},
+#ifdef INPUT_CURVE_ENABLE
+    {PARAMETER  ,"AUX_IN2_EXPO"       ,ADD_PARAM(input2[1].expo)             ,NULL                      ,75         ,INPUT2_EXPO       ,0      ,0      ,100    ,0               ,0    ,0     ,0                  ,"Aux. input2 expo %"},
+#endif
     {VARIABLE   ,"AUX_IN2_CMD"        ,ADD_PARAM(input2[1].cmd)              ,NULL                      ,0          ,0                 ,0      ,0      ,0      ,0               ,0    ,0     ,0                  ,"Aux. input2 cmd"},
 #endif  
   // FEEDBACK
@@ -137,11 +316,49 @@ const parameter_entry params[] = {
     {VARIABLE   ,"SPD_AVG"            ,ADD_PARAM(speedAvg)                   ,NULL                      ,0          ,0                 ,0      ,0      ,0      ,0               ,0    ,0     ,NULL               ,"Motor Measured Avg RPM"},
     {VARIABLE   ,"SPDL"               ,ADD_PARAM(rtY_Left.n_mot)             ,NULL                      ,0          ,0                 ,0      ,0      ,0      ,0               ,0    ,0     ,NULL               ,"Left Motor Measured RPM"},
     {VARIABLE   ,"SPDR"               ,ADD_PARAM(rtY_Right.n_mot)            ,NULL                      ,0          ,0                 ,0      ,0      ,0      ,0               ,0    ,0     ,NULL               ,"Right Motor Measured RPM"},
+#ifdef POSITION_CONTROL
+    {VARIABLE   ,"POSL"               ,ADD_PARAM(posCtrlLeft.z_pos)          ,NULL                      ,0          ,0                 ,0      ,0      ,0      ,0               ,0    ,0     ,NULL               ,"Left Motor Position counts"},
+    {VARIABLE   ,"POSR"               ,ADD_PARAM(posCtrlRight.z_pos)         ,NULL                      ,0          ,0                 ,0      ,0      ,0      ,0               ,0    ,0     ,NULL               ,"Right Motor Position counts"},
+#endif
+#ifdef REGEN_LIMIT_ENABLE
+    {VARIABLE   ,"REGEN_CURR"         ,ADD_PARAM(regenLim.i_regen)           ,NULL                      ,0          ,0                 ,0      ,0      ,0      ,0               ,0    ,0     ,NULL               ,"Regen DC current ADC bits"},
+    {VARIABLE   ,"REGEN_FAC"          ,ADD_PARAM(regenLim.r_fac)             ,NULL                      ,0          ,0                 ,0      ,0      ,0      ,0               ,0    ,0     ,NULL               ,"Regen factor fixdt(0,16,15)"},
+#endif
+#ifdef BAT_LIMIT_ENABLE
+    {VARIABLE   ,"BAT_CURR"           ,ADD_PARAM(batLim.i_bat)               ,NULL                      ,0          ,0                 ,0      ,0      ,0      ,0               ,0    ,0     ,NULL               ,"Battery current ADC bits"},
+    {VARIABLE   ,"BAT_LIM_FAC"        ,ADD_PARAM(batLim.r_fac)               ,NULL                      ,0          ,0                 ,0      ,0      ,0      ,0               ,0    ,0     ,NULL               ,"Battery limit factor fixdt(0,16,15)"},
+#endif
+#ifdef MOT_THERM_ENABLE
+    {VARIABLE   ,"MOT_TEMPL"          ,ADD_PARAM(motThermLeft.T_wind)        ,NULL                      ,0          ,0                 ,0      ,0      ,0      ,0               ,0    ,0     ,NULL               ,"Left motor winding temp °C *10"},
+    {VARIABLE   ,"MOT_TEMPR"          ,ADD_PARAM(motThermRight.T_wind)       ,NULL                      ,0          ,0                 ,0      ,0      ,0      ,0               ,0    ,0     ,NULL               ,"Right motor winding temp °C *10"},
+#endif
+#ifdef TRACTION_CTRL
+    {VARIABLE   ,"TRC_FACL"           ,ADD_PARAM(tractionLeft.r_fac)         ,NULL                      ,0          ,0                 ,0      ,0      ,0      ,0               ,0    ,0     ,NULL               ,"Left traction trq factor fixdt(0,16,15)"},
+    {VARIABLE   ,"TRC_FACR"           ,ADD_PARAM(tractionRight.r_fac)        ,NULL                      ,0          ,0                 ,0      ,0      ,0      ,0               ,0    ,0     ,NULL               ,"Right traction trq factor fixdt(0,16,15)"},
+#endif
+#ifdef ABS_BRAKE_ENABLE
+    {VARIABLE   ,"ABS_FACL"           ,ADD_PARAM(absLeft.r_fac)              ,NULL                      ,0          ,0                 ,0      ,0      ,0      ,0               ,0    ,0     ,NULL               ,"Left ABS brake factor fixdt(0,16,15)"},
+    {VARIABLE   ,"ABS_FACR"           ,ADD_PARAM(absRight.r_fac)             ,NULL                      ,0          ,0                 ,0      ,0      ,0      ,0               ,0    ,0     ,NULL               ,"Right ABS brake factor fixdt(0,16,15)"},
+#endif
+#ifdef CRUISE_PI_ENABLE
+    {VARIABLE   ,"CRUISE_TGT"         ,ADD_PARAM(cruisePI.n_tgt)             ,NULL                      ,0          ,0                 ,0      ,0      ,0      ,0               ,0    ,0     ,NULL               ,"Cruise speed target RPM"},
+#endif
+#ifdef HILL_HOLD_ENABLE
+    {VARIABLE   ,"HOLD_TRQL"          ,ADD_PARAM(hillHoldLeft.r_trq)         ,NULL                      ,0          ,0                 ,0      ,0      ,0      ,0               ,0    ,0     ,NULL               ,"Left hill hold trq target"},
+    {VARIABLE   ,"HOLD_TRQR"          ,ADD_PARAM(hillHoldRight.r_trq)        ,NULL                      ,0          ,0                 ,0      ,0      ,0      ,0               ,0    ,0     ,NULL               ,"Right hill hold trq target"},
+#endif
+#ifdef HALL_CALIB_ENABLE
+    {VARIABLE   ,"HALL_OFFL"          ,ADD_PARAM(hallCalibLeft.a_offset)     ,NULL                      ,0          ,0                 ,0      ,0      ,0      ,0               ,0    ,4     ,NULL               ,"Left hall offset Deg"},
+    {VARIABLE   ,"HALL_OFFR"          ,ADD_PARAM(hallCalibRight.a_offset)    ,NULL                      ,0          ,0                 ,0      ,0      ,0      ,0               ,0    ,4     ,NULL               ,"Right hall offset Deg"},
+#endif
     {VARIABLE   ,"RATE"               ,0       , NULL                        ,NULL                      ,0          ,RATE              ,0      ,0      ,0      ,0               ,0    ,4     ,NULL               ,"Rate *10"},
     {VARIABLE   ,"SPD_COEF"           ,0       , NULL                        ,NULL                      ,0          ,SPEED_COEFFICIENT ,0      ,0      ,0      ,0               ,10   ,14    ,NULL               ,"Speed Coefficient *10"},
     {VARIABLE   ,"STR_COEF"           ,0       , NULL                        ,NULL                      ,0          ,STEER_COEFFICIENT ,0      ,0      ,0      ,0               ,10   ,14    ,NULL               ,"Steer Coefficient *10"},
     {VARIABLE   ,"BATV"               ,ADD_PARAM(batVoltageCalib)            ,NULL                      ,0          ,0                 ,0      ,0      ,0      ,0               ,0    ,0     ,NULL               ,"Calibrated Battery voltage *100"},       
     {VARIABLE   ,"TEMP"               ,ADD_PARAM(board_temp_deg_c)           ,NULL                      ,0          ,0                 ,0      ,0      ,0      ,0               ,0    ,0     ,NULL               ,"Calibrated Temperature °C *10"},       
+#if TEMP_DERATE_ENABLE
+    {VARIABLE   ,"TEMP_DER_FAC"       ,ADD_PARAM(tempDerate)                 ,NULL                      ,0          ,0                 ,0      ,0      ,0      ,0               ,0    ,0     ,NULL               ,"Temperature derating factor fixdt(0,16,15)"},
+#endif
 
 };
 
@@ -294,51 +511,51 @@ int8_t watchParamVal(uint8_t index){
 int8_t printParamVal(){
   int8_t i = 0; 
   for(i=0;i < MAX_PARAM_WATCH && watchParamList[i]>-1;i++){
-    printf("%s:%li ",params[watchParamList[i]].name,getParamValExt(watchParamList[i]));
+    fmtPrint("%s:%li ",params[watchParamList[i]].name,getParamValExt(watchParamList[i]));
   }
-  if (i>0) printf("\r\n");
+  if (i>0) fmtPrint("\r\n");
   return 1;
 }
 
 // Print help for Command
 int8_t printCommandHelp(uint8_t index){
-  printf("? %s:\"%s\"\r\n",commands[index].name,commands[index].help);
+  fmtPrint("? %s:\"%s\"\r\n",commands[index].name,commands[index].help);
   return 1;
 }
 
 // Print help for parameter
 int8_t printParamHelp(uint8_t index){
-  printf("? %s:\"%s\" ",params[index].name,params[index].help);
-  if (params[index].type == PARAMETER) printf("[min:%li max:%li]",params[index].min,params[index].max);
-  printf("\r\n");
+  fmtPrint("? %s:\"%s\" ",params[index].name,params[index].help);
+  if (params[index].type == PARAMETER) fmtPrint("[min:%li max:%li]",params[index].min,params[index].max);
+  fmtPrint("\r\n");
   return 1;
 }
 
 // Print help for all parameters
 int8_t printAllParamHelp(){
-  printf("? Commands\r\n");
+  fmtPrint("? Commands\r\n");
   for(int i=0;i<COMMAND_SIZE(commands);i++)
     printCommandHelp(i);
-  printf("?\r\n");
+  fmtPrint("?\r\n");
 
-  printf("? Parameters\r\n");
+  fmtPrint("? Parameters\r\n");
   for(int i=0;i<PARAM_SIZE(params);i++){
     if (params[i].type == PARAMETER) printParamHelp(i);
   }
-  printf("?\r\n");
+  fmtPrint("?\r\n");
 
-  printf("? Variables\r\n");
+  fmtPrint("? Variables\r\n");
   for(int i=0;i<PARAM_SIZE(params);i++){
     if (params[i].type == VARIABLE) printParamHelp(i);
   }
-  printf("?\r\n");
+  fmtPrint("?\r\n");
 
   return 1;
 }
 
 // Print definition(name,value,initial value, min, max) for parameter
 int8_t printParamDef(uint8_t index){
-  printf("# name:\"%s\" value:%li init:%li min:%li max:%li\r\n",
+  fmtPrint("# name:\"%s\" value:%li init:%li min:%li max:%li\r\n",
          params[index].name,     // Parameter Name
          getParamValExt(index),  // Parameter Value translated to external format
          getParamInitExt(index), // Parameter Init Value translated to external format
@@ -354,7 +571,7 @@ int8_t printAllParamDef(){
 }
 
 void printError(uint8_t errornum ){
-  printf("! Err%i:\"%s\"\r\n",errornum,errors[errornum-1]);
+  fmtPrint("! Err%i:\"%s\"\r\n",errornum,errors[errornum-1]);
 }
 
 // Function to increment a value
@@ -570,10 +787,10 @@ void handle_input(uint8_t *userCommand, uint32_t len)
   if (*userCommand == '-'){len-=1;userCommand+=1;sign =-1;} 
   // Read value
   for (value=0; (unsigned)*userCommand-'0'<10; userCommand++){
+    // Error - Value out of range
+    if (value>(MAX_int32_T-(*userCommand-'0'))/10){command.error = 4;return;}
     value = 10*value+(*userCommand-'0');
     count++;
-    // Error - Value out of range
-    if (value>MAX_int16_T){command.error = 4;return;}
   }
 
   if (count == 0){
@@ -624,7 +841,7 @@ void process_debug()
       command.param_index == -1){
     // This function needs no parameter
     ret = (*commands[command.command_index].callback_function0)();
-    if (ret==1){printf("OK\r\n");}
+    if (ret==1){fmtPrint("OK\r\n");}
     command.semaphore = 0;
     return;
   }
@@ -633,7 +850,7 @@ void process_debug()
       command.param_index != -1){
     // This function needs only a parameter
     ret = (*commands[command.command_index].callback_function1)(command.param_index);
-    if (ret==1){printf("OK\r\n");}
+    if (ret==1){fmtPrint("OK\r\n");}
     command.semaphore = 0;
     return;
   }  
@@ -642,7 +859,7 @@ void process_debug()
       command.param_index != -1){
     // This function needs an additional parameter
     ret = (*commands[command.command_index].callback_function2)(command.param_index,command.param_value);
-    if (ret==1){printf("OK\r\n");}
+    if (ret==1){fmtPrint("OK\r\n");}
     command.semaphore = 0;
   }
 }
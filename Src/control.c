@@ -217,129 +217,182 @@ void PWM_Init(void) {
 }
 #endif
 
-uint8_t Nunchuk_tx(uint8_t i2cBuffer[], uint8_t i2cBufferLength) {
-  if(HAL_I2C_Master_Transmit(&hi2c2,NUNCHUK_I2C_ADDRESS,(uint8_t*)i2cBuffer, i2cBufferLength, 100) == HAL_OK) {
-    return true;
-  }
-  return false;
-}
-
-uint8_t Nunchuk_rx(uint8_t i2cBuffer[], uint8_t i2cBufferLength) {
-  if(HAL_I2C_Master_Receive(&hi2c2,NUNCHUK_I2C_ADDRESS,(uint8_t*)i2cBuffer, i2cBufferLength, 100) == HAL_OK) {
-    return true;
-  }
-  return false;
-}
-
-uint8_t Nunchuk_Init(void) {
-  //-- START -- init WiiNunchuk
-  i2cBuffer[0] = 0xF0;
-  i2cBuffer[1] = 0x55;
-
-  if(Nunchuk_tx(i2cBuffer, 2) == false) {
-    return false;
-  }
-  HAL_Delay(10);
-
-  i2cBuffer[0] = 0xFB;
-  i2cBuffer[1] = 0x00;
-
-  if(Nunchuk_tx(i2cBuffer, 2) == false) {
-    return false;
-  }
-  HAL_Delay(10);
-
-  return true;
-}
-
-uint8_t Nunchuk_Connect() {
-  /* Initialise / re-initialise I2C peripheral */
-  I2C_Init();
-  
-  /* Initialise / re-initialise nunchuk */
-  if(Nunchuk_Init() == true) {
-    nunchukState = NUNCHUK_CONNECTED;
-    return true;
-  } else {
-    return false;
-  }
+/* Nunchuk polling state machine
+ * Nunchuk_Read() is called from the main loop and never waits: it starts an interrupt driven I2C transfer on hi2c2,
+ * or checks if the previous one is finished, or checks if the gap after it is elapsed (timed by the HAL tick).
+ * The bus is shared with the LCD: a transfer is only started when the bus is free.
+ * Sequence: init 0xF0 0x55 (10 ms), init 0xFB 0x00 (10 ms), then repeated: read address 0x00 (3 ms), read 6 bytes (3 ms)
+ * When a gap is elapsed the next transfer is started in the same call, so a sample takes 4 calls (20 ms in the main loop).
+ */
+typedef enum {
+  NUNCHUK_PH_INIT1,                   // send init sequence part 1
+  NUNCHUK_PH_INIT2,                   // send init sequence part 2
+  NUNCHUK_PH_ADDR,                    // send read address
+  NUNCHUK_PH_DATA                     // read data
+} nunchuk_phase;
+
+typedef enum {
+  NUNCHUK_XFER_IDLE,                  // waiting for a free bus to start the transfer
+  NUNCHUK_XFER_BUSY,                  // transfer ongoing
+  NUNCHUK_XFER_GAP                    // transfer finished, waiting for the gap to elapse
+} nunchuk_xfer;
+
+#define NUNCHUK_INIT_GAP      10      // [ms] gap after each init transfer
+#define NUNCHUK_READ_GAP      3       // [ms] gap after each read transfer
+#define NUNCHUK_XFER_TIMEOUT  10      // [ms] max transfer duration or bus busy time before the bus is considered stuck
+#define NUNCHUK_SAMPLE_AGE    100     // [ms] max sample age when connected, before reconnecting. Several sample periods
+#define NUNCHUK_RETRY_DELAY   500     // [ms] delay before reconnecting when disconnected
+
+static nunchuk_phase nunchukPhase = NUNCHUK_PH_INIT1;
+static nunchuk_xfer  nunchukXfer  = NUNCHUK_XFER_IDLE;
+static uint32_t nunchukTick;          // [ms] start of the current step (wait for bus, transfer, gap or retry delay)
+static uint32_t nunchukSampleTick;    // [ms] time of the latest valid sample
+static uint8_t  nunchukRx[6];
+
+static void Nunchuk_Fail(void) {
+  /* Brings motors to safe stop */
+  /* Expected values from nunchuk for stopped (mid) position */
+  memset(nunchuk_data, 0, sizeof(nunchuk_data));
+  nunchuk_data[0] = 127;
+  nunchuk_data[1] = 128;
+  timeoutFlgGen   = 1;
+
+  /* Connected: try to reconnect once, else fall back to disconnected state */
+  nunchukState = (nunchukState == NUNCHUK_CONNECTED) ? NUNCHUK_RECONNECTING : NUNCHUK_DISCONNECTED;
+  nunchukPhase = NUNCHUK_PH_INIT1;
+  nunchukXfer  = NUNCHUK_XFER_IDLE;
+  nunchukTick  = HAL_GetTick();
 }
 
-nunchuk_state Nunchuk_Read(void) {
-  static uint8_t delay_counter = 0;
-  uint16_t checksum = 0;
-  uint8_t success = true;
-  uint8_t i = 0;
-
-  switch(nunchukState) {
-    case NUNCHUK_DISCONNECTED:
-      success = false;
-      /* Delay a bit before reconnecting */
-      if(delay_counter++ > 100) {
-        success = Nunchuk_Connect();
-        delay_counter = 0;
+/* Runs one transfer step. Returns 1 once the transfer is finished and its gap is elapsed, else 0. */
+static uint8_t Nunchuk_Xfer(uint8_t *buf, uint8_t len, uint8_t rx, uint32_t gap) {
+  switch (nunchukXfer) {
+    case NUNCHUK_XFER_IDLE:
+      if (HAL_I2C_GetState(&hi2c2) == HAL_I2C_STATE_RESET) {
+        I2C_Init();
       }
-      break;
-      
-    case NUNCHUK_CONNECTING:
-    case NUNCHUK_RECONNECTING:
-        /* Try to reconnect once, if fails again fall back to disconnected state */
-        success = Nunchuk_Connect();
-        if(!success) {
-          nunchukState = NUNCHUK_DISCONNECTED;
+      if (HAL_I2C_GetState(&hi2c2) != HAL_I2C_STATE_READY || __HAL_I2C_GET_FLAG(&hi2c2, I2C_FLAG_BUSY)) {
+        if (HAL_GetTick() - nunchukTick > NUNCHUK_XFER_TIMEOUT) {
+          I2C_Init();                 // stuck bus: reset the peripheral, retry on the next call
+          nunchukTick = HAL_GetTick();
         }
-      break;
-
-    case NUNCHUK_CONNECTED:
-      /* Send read address of 0x00 to the Nunchuk */
-      i2cBuffer[0] = 0x00;
-      if(!Nunchuk_tx(i2cBuffer, 1)) {
-        success = false;
-      }
-      HAL_Delay(3);
-
-      /* Clear the receive data buffer */
-      for(i = 0; i<6; i++) {
-        nunchuk_data[i] = 0;
+        break;
       }
-
-      /* Read back 6 bytes from the Nunchuk */
-      if(!Nunchuk_rx(nunchuk_data, 6)) {
-        success = false;
+      if ((rx ? HAL_I2C_Master_Receive_IT (&hi2c2, NUNCHUK_I2C_ADDRESS, buf, len)
+              : HAL_I2C_Master_Transmit_IT(&hi2c2, NUNCHUK_I2C_ADDRESS, buf, len)) == HAL_OK) {
+        nunchukXfer = NUNCHUK_XFER_BUSY;
+        nunchukTick = HAL_GetTick();
       }
-      HAL_Delay(3);
+      break;
 
-      /* Checksum the receive buffer to ensure it is not in an error condition, i.e. all 0x00 or 0xFF */
-      for(i = 0; i<6; i++) {
-        checksum += nunchuk_data[i];
-      }
-      if(checksum == 0 || checksum == 0x5FA) {
-        success = false;
+    case NUNCHUK_XFER_BUSY:
+      if (HAL_I2C_GetState(&hi2c2) != HAL_I2C_STATE_READY) {
+        if (HAL_GetTick() - nunchukTick > NUNCHUK_XFER_TIMEOUT) {
+          I2C_Init();                 // transfer stuck: reset the peripheral
+          Nunchuk_Fail();
+        }
+      } else if (HAL_I2C_GetError(&hi2c2) != HAL_I2C_ERROR_NONE) {
+        Nunchuk_Fail();               // e.g. no acknowledge: nunchuk not connected
+      } else {
+        nunchukXfer = NUNCHUK_XFER_GAP;
+        nunchukTick = HAL_GetTick();
       }
+      break;
 
-      /* Comms failure or timeout counter reached timeout limit */
-      if(success == false || timeoutCntGen > 3) {
-        /* Clear the receive data buffer */
-        for(i = 0; i<6; i++) {
-          nunchuk_data[i] = 0;
-        }
-        /* Brings motors to safe stop */
-        /* Expected values from nunchuk for stopped (mid) position */
-        nunchuk_data[0] = 127;
-        nunchuk_data[1] = 128;
-        timeoutFlgGen = 1;
-        nunchukState = NUNCHUK_RECONNECTING;
+    case NUNCHUK_XFER_GAP:
+      if (HAL_GetTick() - nunchukTick > gap) {
+        nunchukXfer = NUNCHUK_XFER_IDLE;
+        nunchukTick = HAL_GetTick();
+        return 1;
       }
       break;
   }
-  /* Reset the timeout flag and counter if successful communication */
-  if(success == true) {
-    timeoutCntGen = 0;
-    timeoutFlgGen = 0;
-  }
+  return 0;
+}
+
+nunchuk_state Nunchuk_Read(void) {
+  uint16_t checksum;
+  uint8_t i = 0;
+  uint8_t next;                       // a step is finished: continue with the next one in the same call
+
+  do {
+    next = 0;
+    switch(nunchukState) {
+      case NUNCHUK_DISCONNECTED:
+        /* Delay a bit before reconnecting */
+        if (HAL_GetTick() - nunchukTick > NUNCHUK_RETRY_DELAY) {
+          nunchukState = NUNCHUK_RECONNECTING;
+          nunchukTick  = HAL_GetTick();
+          next         = 1;
+        }
+        break;
+
+      case NUNCHUK_CONNECTING:
+      case NUNCHUK_RECONNECTING:
+        //-- START -- init WiiNunchuk
+        if (nunchukPhase == NUNCHUK_PH_INIT1) {
+          i2cBuffer[0] = 0xF0;
+          i2cBuffer[1] = 0x55;
+          if (Nunchuk_Xfer(i2cBuffer, 2, 0, NUNCHUK_INIT_GAP)) {
+            nunchukPhase = NUNCHUK_PH_INIT2;
+            next         = 1;
+          }
+        } else {
+          i2cBuffer[0] = 0xFB;
+          i2cBuffer[1] = 0x00;
+          if (Nunchuk_Xfer(i2cBuffer, 2, 0, NUNCHUK_INIT_GAP)) {
+            nunchukState      = NUNCHUK_CONNECTED;
+            nunchukPhase      = NUNCHUK_PH_ADDR;
+            nunchukSampleTick = HAL_GetTick();
+            next              = 1;
+          }
+        }
+        break;
+
+      case NUNCHUK_CONNECTED:
+        if (nunchukPhase == NUNCHUK_PH_ADDR) {
+          /* Send read address of 0x00 to the Nunchuk */
+          i2cBuffer[0] = 0x00;
+          if (Nunchuk_Xfer(i2cBuffer, 1, 0, NUNCHUK_READ_GAP)) {
+            nunchukPhase = NUNCHUK_PH_DATA;
+            memset(nunchukRx, 0, sizeof(nunchukRx));
+            next         = 1;
+          }
+        } else if (Nunchuk_Xfer(nunchukRx, 6, 1, NUNCHUK_READ_GAP)) {
+          /* Read back 6 bytes from the Nunchuk */
+          nunchukPhase = NUNCHUK_PH_ADDR;
+          next         = 1;
+
+          /* Checksum the receive buffer to ensure it is not in an error condition, i.e. all 0x00 or 0xFF */
+          checksum = 0;
+          for(i = 0; i<6; i++) {
+            checksum += nunchukRx[i];
+          }
+          if (checksum != 0 && checksum != 0x5FA) {
+            memcpy(nunchuk_data, nunchukRx, sizeof(nunchuk_data));
+            nunchukSampleTick = HAL_GetTick();
+            /* Reset the timeout flag and counter on a valid sample */
+            timeoutCntGen = 0;
+            timeoutFlgGen = 0;
+          }
+        }
+
+        /* Comms failure: no valid sample for too long */
+        if (nunchukState == NUNCHUK_CONNECTED && Nunchuk_SampleAge() > NUNCHUK_SAMPLE_AGE) {
+          Nunchuk_Fail();
+          next = 0;
+        }
+        break;
+    }
+  } while (next);                     // ends at the latest when a transfer is started or the bus is busy
   return nunchukState;
   //setScopeChannel(0, (int)nunchuk_data[0]);
   //setScopeChannel(1, (int)nunchuk_data[1]);
   //setScopeChannel(2, (int)nunchuk_data[5] & 1);
   //setScopeChannel(3, ((int)nunchuk_data[5] >> 1) & 1);
 }
+
+/* Age of the latest valid sample in nunchuk_data [ms] */
+uint32_t Nunchuk_SampleAge(void) {
+  return HAL_GetTick() - nunchukSampleTick;
+}
@@ -0,0 +1,235 @@
+/**
+  * This file is part of the hoverboard-firmware-hack project.
+  *
+  * Copyright (C) 2020-2021 Emanuel FERU <aerdronix@gmail.com>
+  *
+  * This program is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * (at your option) any later version.
+  *
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Includes
+#include <stdarg.h>
+#include "stm32f1xx_hal.h"
+#include "config.h"
+#include "format.h"
+
+#if defined(DEBUG_SERIAL_USART2)
+  extern UART_HandleTypeDef huart2;
+  #define UART_DEBUG          huart2
+#elif defined(DEBUG_SERIAL_USART3)
+  extern UART_HandleTypeDef huart3;
+  #define UART_DEBUG          huart3
+#endif
+
+#define FMT_BUF_SIZE          64        // [-] fmtPrint output chunk size
+
+static const uint16_t pow10Tab[FMT_FIX_DIGITS_MAX + 1] = {1, 10, 100, 1000, 10000};
+
+
+/* =========================== Number Formatting Functions =========================== */
+
+/* fmtUInt(s, x)
+ * Unsigned decimal
+ * Inputs:       x = value
+ * Outputs:      s = string, return = length
+ */
+uint8_t fmtUInt(char *s, uint32_t x) {
+  char    tmp[10];
+  uint8_t n = 0, len = 0;
+
+  do {
+    tmp[n++] = '0' + (x % 10);
+    x /= 10;
+  } while (x);
+  while (n) { s[len++] = tmp[--n]; }
+  s[len] = '\0';
+
+  return len;
+}
+
+/* fmtInt(s, x)
+ * Signed decimal
+ * Inputs:       x = value
+ * Outputs:      s = string, return = length
+ */
+uint8_t fmtInt(char *s, int32_t x) {
+  if (x < 0) {
+    *s = '-';
+    return fmtUInt(s + 1, -(uint32_t)x) + 1;
+  }
+  return fmtUInt(s, (uint32_t)x);
+}
+
+/* fmtHex(s, x, digits)
+ * Upper case hexadecimal, zero padded to at least 'digits' characters
+ * Inputs:       x = value, digits = minimum width [1, 8]
+ * Outputs:      s = string, return = length
+ */
+uint8_t fmtHex(char *s, uint32_t x, uint8_t digits) {
+  uint8_t len = 8;
+
+  while (len > 1 && len > digits && !(x >> ((len - 1) << 2))) { len--; }
+  for (uint8_t i = 0; i < len; i++) {
+    uint8_t nib = (x >> ((len - 1 - i) << 2)) & 0x0F;
+    s[i] = nib < 10 ? '0' + nib : 'A' - 10 + nib;
+  }
+  s[len] = '\0';
+
+  return len;
+}
+
+/* fmtFix(s, x, scale, digits)
+ * Fixed decimals from a scaled integer: prints x / scale rounded half away from zero to 'digits' decimals.
+ * Example: fmtFix(s, 1234, 100, 1) = "12.3", fmtFix(s, 1345, 1345, 2) = "1.00"
+ * Only 32-bit integer math is used: the remainder (< scale) times 10^digits always fits in 32 bits.
+ * Inputs:       x = scaled value, scale = units per 1 (> 0), digits = decimals [0, FMT_FIX_DIGITS_MAX]
+ * Outputs:      s = string, return = length
+ */
+uint8_t fmtFix(char *s, int32_t x, uint16_t scale, uint8_t digits) {
+  uint32_t xAbs, ip, fp, pw;
+  uint8_t  len = 0;
+
+  if (digits > FMT_FIX_DIGITS_MAX) { digits = FMT_FIX_DIGITS_MAX; }
+  if (scale == 0)                  { scale  = 1; }
+  pw   = pow10Tab[digits];
+  xAbs = x < 0 ? -(uint32_t)x : (uint32_t)x;
+  ip   = xAbs / scale;
+  fp   = ((xAbs % scale) * pw + (scale >> 1)) / scale;
+  if (fp >= pw) {                               // rounding carried into the integer part
+    fp -= pw;
+    ip++;
+  }
+
+  if (x < 0 && (ip || fp)) { s[len++] = '-'; }
+  len += fmtUInt(s + len, ip);
+  if (digits) {
+    s[len++] = '.';
+    while (digits--) {
+      pw /= 10;
+      s[len++] = '0' + (fp / pw) % 10;
+    }
+    s[len] = '\0';
+  }
+
+  return len;
+}
+
+
+/* =========================== Debug Print Functions =========================== */
+
+typedef struct {
+  char    buf[FMT_BUF_SIZE];
+  uint8_t len;
+  int     cnt;
+} FmtOut;
+
+static void fmtFlush(FmtOut *o) {
+  #ifdef UART_DEBUG
+    if (o->len) {
+      HAL_UART_Transmit(&UART_DEBUG, (uint8_t *)o->buf, o->len, 1000);
+    }
+  #endif
+  o->cnt += o->len;
+  o->len  = 0;
+}
+
+static void fmtPut(FmtOut *o, const char *s, uint8_t len, uint8_t width, char pad) {
+  while (width > len) {
+    if (o->len == FMT_BUF_SIZE) { fmtFlush(o); }
+    o->buf[o->len++] = pad;
+    width--;
+  }
+  while (len--) {
+    if (o->len == FMT_BUF_SIZE) { fmtFlush(o); }
+    o->buf[o->len++] = *s++;
+  }
+}
+
+/* fmtPrint(fmt, ...)
+ * Formats into a small buffer that is sent in chunks over the debug serial (blocking, like the former printf retarget).
+ * Without DEBUG_SERIAL_USART2/3 the output is dropped.
+ * Outputs:      return = number of characters
+ */
+int fmtPrint(const char *fmt, ...) {
+  FmtOut  o = { .len = 0, .cnt = 0 };
+  char    num[12];
+  va_list ap;
+
+  va_start(ap, fmt);
+  while (*fmt) {
+    if (*fmt != '%') {
+      fmtPut(&o, fmt++, 1, 0, ' ');
+      continue;
+    }
+    fmt++;
+
+    char    pad   = ' ';
+    uint8_t width = 0;
+    if (*fmt == '0') { pad = '0'; fmt++; }
+    while (*fmt >= '0' && *fmt <= '9') { width = width * 10 + (*fmt++ - '0'); }
+    if (*fmt == 'l') { fmt++; }               // long and int are both 32 bits on this target
+
+    switch (*fmt) {
+      case 'd':
+      case 'i': {
+        int32_t v = va_arg(ap, int32_t);
+        if (v < 0 && pad == '0') {            // zero padding goes after the sign
+          fmtPut(&o, "-", 1, 0, pad);
+          fmtPut(&o, num, fmtUInt(num, -(uint32_t)v), width ? width - 1 : 0, pad);
+        } else {
+          fmtPut(&o, num, fmtInt(num, v), width, pad);
+        }
+        break;
+      }
+      case 'u':
+        fmtPut(&o, num, fmtUInt(num, va_arg(ap, uint32_t)), width, pad);
+        break;
+      case 'x':
+      case 'X': {
+        uint8_t len = fmtHex(num, va_arg(ap, uint32_t), 1);
+        if (*fmt == 'x') {
+          for (uint8_t i = 0; i < len; i++) { num[i] |= (num[i] > '9') ? 0x20 : 0; }  // lower case letters
+        }
+        fmtPut(&o, num, len, width, pad);
+        break;
+      }
+      case 'c':
+        num[0] = (char)va_arg(ap, int);
+        fmtPut(&o, num, 1, width, pad);
+        break;
+      case 's': {
+        const char *str = va_arg(ap, const char *);
+        uint8_t     len = 0;
+        while (str[len] && len < width) { len++; }
+        fmtPut(&o, "", 0, width - len, ' ');
+        while (*str) { fmtPut(&o, str++, 1, 0, ' '); }
+        break;
+      }
+      case '\0':                               // trailing '%'
+        fmtPut(&o, "%", 1, 0, ' ');
+        continue;
+      case '%':
+        fmtPut(&o, "%", 1, 0, ' ');
+        break;
+      default:                                  // unsupported conversion: print it verbatim
+        fmtPut(&o, "%", 1, 0, ' ');
+        fmtPut(&o, fmt, 1, 0, ' ');
+        break;
+    }
+    fmt++;
+  }
+  va_end(ap);
+  fmtFlush(&o);
+
+  return o.cnt;
+}
@@ -6,6 +6,7 @@
  */
 
 #include "hd44780.h"
+#include "format.h"
 
 uint32_t PCF8574_Type0Pins[8] = { 4, 5, 6, 7, 0, 1, 2, 3 };
 uint8_t LCDerrorFlag = 0;
@@ -239,6 +240,8 @@ LCD_RESULT LCD_WriteString(LCD_PCF8574_HandleTypeDef* handle, char *s) {
 }
 
 LCD_RESULT LCD_ClearDisplay(LCD_PCF8574_HandleTypeDef* handle) {
+	LCD_FB_Clear(handle);
+	handle->dirty = 0;	// the display is cleared by the command below, the framebuffer matches it
 	return LCD_WriteCMD(handle, 1);
 }
 
@@ -342,39 +345,12 @@ LCD_RESULT LCD_WriteNumber(LCD_PCF8574_HandleTypeDef* handle, unsigned long n,
 	return LCD_WriteString(handle, str);
 }
 
-LCD_RESULT LCD_WriteFloat(LCD_PCF8574_HandleTypeDef* handle, double number,
-		uint8_t digits) {
-	// Handle negative numbers
-	if (number < 0.0) {
-		LCD_WriteString(handle,"-");
-		number = -number;
-	}
-
-	// Round correctly so that print(1.999, 2) prints as "2.00"
-	double rounding = 0.5;
-	for (uint8_t i = 0; i < digits; ++i)
-		rounding /= 10.0;
-
-	number += rounding;
-
-	// Extract the integer part of the number and print it
-	unsigned long int_part = (unsigned long) number;
-	double remainder = number - (double) int_part;
-	LCD_WriteNumber(handle,int_part,10);
-
-	// Print the decimal point, but only if there are digits beyond
-	if (digits > 0) {
-		LCD_WriteString(handle,".");
-	}
+LCD_RESULT LCD_WriteFixed(LCD_PCF8574_HandleTypeDef* handle, int32_t number,
+		uint16_t scale, uint8_t digits) {
+	char str[12];
 
-	// Extract digits from the remainder one at a time
-	while (digits-- > 0) {
-		remainder *= 10.0;
-		int toPrint = (int)(remainder);
-		LCD_WriteNumber(handle,toPrint,10);
-		remainder -= toPrint;
-	}
-	return LCD_OK;
+	fmtFix(str, number, scale, digits);
+	return LCD_WriteString(handle, str);
 }
 
 LCD_RESULT LCD_EntryModeSet(LCD_PCF8574_HandleTypeDef* handle,
@@ -400,3 +376,94 @@ LCD_RESULT LCD_CustomChar(LCD_PCF8574_HandleTypeDef* handle, uint8_t *pattern,
 	}
 	return LCD_OK;
 }
+
+/* Framebuffer functions
+ * The application writes to handle->lcdbuf. LCD_FB_Update() sends the changed characters in the background:
+ * one I2C DMA transfer holds the set-address command plus up to LCD_FB_BURST characters, each as 4 expander
+ * bytes (high nibble with E high, E low, low nibble with E high, E low). At 200 kHz one byte takes ~45 us,
+ * which also covers the 37 us execution time of the HD44780, so no busy-flag polling is needed.
+ */
+static uint8_t LCD_FB_Byte(LCD_PCF8574_HandleTypeDef* handle, uint8_t* buf,
+		uint8_t data, uint8_t rs) {
+	uint8_t base = handle->state & (1 << handle->pins[LCD_PIN_LED]);
+	if (rs) {
+		base |= 1 << handle->pins[LCD_PIN_RS];
+	}
+
+	for (uint8_t i = 0; i < 2; i++) {
+		uint8_t nibble = i ? data & 0x0F : data >> 4;
+		uint8_t val = base;
+		for (uint8_t b = 0; b < 4; b++) {
+			if (nibble & (1 << b)) {
+				val |= 1 << handle->pins[LCD_PIN_D4 + b];
+			}
+		}
+		*buf++ = val | (1 << handle->pins[LCD_PIN_E]);
+		*buf++ = val;
+	}
+	return 4;
+}
+
+void LCD_FB_Clear(LCD_PCF8574_HandleTypeDef* handle) {
+	for (uint8_t y = 0; y < LCD_FB_ROWS; y++) {
+		LCD_FB_SetLocation(handle, 0, y);
+		while (handle->x < LCD_FB_COLS) {
+			LCD_FB_WriteString(handle, " ");
+		}
+	}
+	LCD_FB_SetLocation(handle, 0, 0);
+}
+
+void LCD_FB_SetLocation(LCD_PCF8574_HandleTypeDef* handle, uint8_t x,
+		uint8_t y) {
+	handle->x = x < LCD_FB_COLS ? x : LCD_FB_COLS;
+	handle->y = y < LCD_FB_ROWS ? y : LCD_FB_ROWS - 1;
+}
+
+void LCD_FB_WriteString(LCD_PCF8574_HandleTypeDef* handle, const char *s) {
+	while (s != 0 && *s != 0 && handle->x < LCD_FB_COLS) {
+		if (handle->lcdbuf[handle->y][handle->x] != *s) {
+			handle->lcdbuf[handle->y][handle->x] = *s;
+			handle->dirty |= 1UL << (handle->y * LCD_FB_COLS + handle->x);
+		}
+		handle->x++;
+		s++;
+	}
+}
+
+void LCD_FB_WriteFixed(LCD_PCF8574_HandleTypeDef* handle, int32_t number,
+		uint16_t scale, uint8_t digits) {
+	char str[12];
+
+	fmtFix(str, number, scale, digits);
+	LCD_FB_WriteString(handle, str);
+}
+
+LCD_RESULT LCD_FB_Update(LCD_PCF8574_HandleTypeDef* handle) {
+	if (LCDerrorFlag) {
+		return LCD_ERROR;
+	}
+	if (handle->dirty == 0 || !PCF8574_IsReady(&handle->pcf8574)) {
+		return LCD_OK;
+	}
+
+	uint8_t pos = 0;
+	while (!(handle->dirty & (1UL << pos))) {
+		pos++;
+	}
+	uint8_t row = pos / LCD_FB_COLS;
+	uint8_t col = pos % LCD_FB_COLS;
+	uint8_t len = LCD_FB_Byte(handle, handle->txbuf, 0x80 | (0x40 * row + col), 0);	// set DDRAM address
+	uint32_t sent = 0;
+
+	for (uint8_t n = 0; n < LCD_FB_BURST && col + n < LCD_FB_COLS
+			&& (handle->dirty & (1UL << (pos + n))); n++) {
+		len += LCD_FB_Byte(handle, &handle->txbuf[len], handle->lcdbuf[row][col + n], 1);
+		sent |= 1UL << (pos + n);
+	}
+
+	if (PCF8574_WriteAsync(&handle->pcf8574, handle->txbuf, len) == PCF8574_OK) {
+		handle->dirty &= ~sent;	// on a busy bus the characters stay dirty and are sent on the next call
+	}
+	return LCD_OK;
+}
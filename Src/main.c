@@ -20,7 +20,6 @@
 * along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 
-#include <stdio.h>
 #include <stdlib.h> // for abs()
 #include "stm32f1xx_hal.h"
 #include "defines.h"
@@ -30,6 +29,7 @@
 #include "BLDC_controller.h"      /* BLDC's header file */
 #include "rtwtypes.h"
 #include "comms.h"
+#include "format.h"
 
 #if defined(DEBUG_I2C_LCD) || defined(SUPPORT_LCD)
 #include "hd44780.h"
@@ -84,6 +84,25 @@ extern uint8_t enable;                  // global variable for motor enable
 
 extern int16_t batVoltage;              // global variable for battery voltage
 
+#ifdef MOT_THERM_ENABLE
+extern MotTherm motThermLeft;           // Motor thermal models
+extern MotTherm motThermRight;
+#endif
+#if TEMP_DERATE_ENABLE
+extern uint16_t tempDerate;             // Board temperature derating factor
+#endif
+#ifdef CRUISE_PI_ENABLE
+extern CruisePI cruisePI;               // Vehicle speed PI
+extern uint8_t  ctrlModReq;             // Final control mode request
+#endif
+#ifdef TORQUE_MAP_ENABLE
+extern TorqueMap torqueMap;             // Torque map and launch control
+#endif
+#ifdef BIQUAD_ENABLE
+extern Biquad biquadSpeed;              // Command filters
+extern Biquad biquadSteer;
+#endif
+
 #if defined(SIDEBOARD_SERIAL_USART2)
 extern SerialSideboard Sideboard_L;
 #endif
@@ -126,6 +145,13 @@ typedef struct{
   int16_t   batVoltage;
   int16_t   boardTemp;
   uint16_t  cmdLed;
+  #ifdef MOT_THERM_ENABLE
+  int16_t   motTempL;
+  int16_t   motTempR;
+  #endif
+  #if TEMP_DERATE_ENABLE
+  uint16_t  tempDerate;
+  #endif
   uint16_t  checksum;
 } SerialFeedback;
 static SerialFeedback Feedback;
@@ -139,13 +165,17 @@ static uint8_t sideboard_leds_R;
 
 #ifdef VARIANT_TRANSPOTTER
   uint8_t  nunchuk_connected;
-  extern float    setDistance;  
+  extern uint16_t setDistance;         // [mm] follow distance
 
   static uint8_t  checkRemote = 0;
-  static uint16_t distance;
-  static float    steering;
-  static int      distanceErr;  
+  static uint16_t distance;             // [-] gametrak wire length in counts (DIST_CNT_PER_M per meter)
+  static int16_t  steering;             // [-] steering in fixdt(1,16,11): -2048 to 2047 = -1.0 to 1.0
+  static int16_t  distanceErr;  
   static int      lastDistance = 0;
+  #ifdef SUPPORT_NUNCHUK
+  extern uint8_t  nunchuk_data[6];
+  static uint8_t  nunchukBtnPrev;
+  #endif
   static uint16_t transpotter_counter = 0;
 #endif
 
@@ -196,6 +226,9 @@ int main(void) {
   __HAL_RCC_DMA1_CLK_DISABLE();
   MX_GPIO_Init();
   MX_TIM_Init();
+  #if defined(ENCODER_LEFT) || defined(ENCODER_RIGHT)
+  Encoder_Init();
+  #endif
   MX_ADC1_Init();
   MX_ADC2_Init();
   BLDC_Init();        // BLDC Controller Init
@@ -203,6 +236,9 @@ int main(void) {
   HAL_GPIO_WritePin(OFF_PORT, OFF_PIN, GPIO_PIN_SET);   // Activate Latch
   Input_Lim_Init();   // Input Limitations Init
   Input_Init();       // Input Init
+  #ifdef BIQUAD_ENABLE
+  Biquad_Init();      // Command filter coefficients
+  #endif
 
   HAL_ADC_Start(&hadc1);
   HAL_ADC_Start(&hadc2);
@@ -234,7 +270,7 @@ int main(void) {
       rtP_Left.i_max = rtP_Right.i_max = (MULTI_MODE_M1_I_MOT_MAX * A2BIT_CONV) << 4;
     }
 
-    printf("Drive mode %i selected: max_speed:%i acc_rate:%i \r\n", drive_mode, max_speed, rate);
+    fmtPrint("Drive mode %i selected: max_speed:%i acc_rate:%i \r\n", drive_mode, max_speed, rate);
   #endif
 
   // Loop until button is released
@@ -253,6 +289,9 @@ int main(void) {
 
     readCommand();                        // Read Command: input1[inIdx].cmd, input2[inIdx].cmd
     calcAvgSpeed();                       // Calculate average measured speed: speedAvg, speedAvgAbs
+    #ifdef GAIN_SCHED_ENABLE
+      speedGainSched();                   // Update the speed loop gains: cf_nKp, cf_nKi
+    #endif
 
     #ifndef VARIANT_TRANSPOTTER
       // ####### MOTOR ENABLING: Only if the initial input is very small (for SAFETY) #######
@@ -261,9 +300,13 @@ int main(void) {
         beepShort(6);                     // make 2 beeps indicating the motor enable
         beepShort(4); HAL_Delay(100);
         steerFixdt = speedFixdt = 0;      // reset filters
+        #ifdef BIQUAD_ENABLE
+        biquadSteer.x[0] = biquadSteer.x[1] = biquadSteer.y[0] = biquadSteer.y[1] = biquadSteer.e = 0;
+        biquadSpeed.x[0] = biquadSpeed.x[1] = biquadSpeed.y[0] = biquadSpeed.y[1] = biquadSpeed.e = 0;
+        #endif
         enable = 1;                       // enable motors
         #if defined(DEBUG_SERIAL_USART2) || defined(DEBUG_SERIAL_USART3)
-        printf("-- Motors enabled --\r\n");
+        fmtPrint("-- Motors enabled --\r\n");
         #endif
       }
 
@@ -273,7 +316,7 @@ int main(void) {
         speedBlend = (uint16_t)(((CLAMP(speedAvgAbs,10,60) - 10) << 15) / 50); // speedBlend [0,1] is within [10 rpm, 60rpm]
       #endif
 
-      #ifdef STANDSTILL_HOLD_ENABLE
+      #if defined(STANDSTILL_HOLD_ENABLE) || defined(HILL_HOLD_ENABLE)
         standstillHold();                                           // Apply Standstill Hold functionality. Only available and makes sense for VOLTAGE or TORQUE Mode
       #endif
 
@@ -285,7 +328,11 @@ int main(void) {
 
         if (input1[inIdx].cmd > 30) {                               // If Brake pedal (input1) is pressed, bring to 0 also the Throttle pedal (input2) to avoid "Double pedal" driving
           input2[inIdx].cmd = (int16_t)((input2[inIdx].cmd * speedBlend) >> 15);
+          #ifdef CRUISE_PI_ENABLE
+          cruiseControl(cruisePI.b_ena);                            // Cruise control deactivated by Brake pedal if it was active
+          #else
           cruiseControl((uint8_t)rtP_Left.b_cruiseCtrlEna);         // Cruise control deactivated by Brake pedal if it was active
+          #endif
         }
       }
       #endif
@@ -315,12 +362,22 @@ int main(void) {
       #endif
 
       // ####### LOW-PASS FILTER #######
+      #ifdef SCURVE_ENABLE
+      steer = input1[inIdx].cmd;            // shaping is done per wheel by the S-curve generator in the DMA ISR
+      speed = input2[inIdx].cmd;
+      #else
       rateLimiter16(input1[inIdx].cmd, rate, &steerRateFixdt);
       rateLimiter16(input2[inIdx].cmd, rate, &speedRateFixdt);
+      #ifdef BIQUAD_ENABLE
+      filtBiquad32(steerRateFixdt >> 4, &biquadSteer, &steerFixdt);
+      filtBiquad32(speedRateFixdt >> 4, &biquadSpeed, &speedFixdt);
+      #else
       filtLowPass32(steerRateFixdt >> 4, FILTER, &steerFixdt);
       filtLowPass32(speedRateFixdt >> 4, FILTER, &speedFixdt);
+      #endif
       steer = (int16_t)(steerFixdt >> 16);  // convert fixed-point to integer
       speed = (int16_t)(speedFixdt >> 16);  // convert fixed-point to integer
+      #endif
 
       // ####### VARIANT_HOVERCAR #######
       #ifdef VARIANT_HOVERCAR
@@ -338,9 +395,16 @@ int main(void) {
           speed = steer - speed;                // Reverse driving: in this case steer = Brake, speed = Throttle
         }
         steer = 0;                              // Do not apply steering to avoid side effects if STEER_COEFFICIENT is NOT 0
+        #ifdef TORQUE_MAP_ENABLE
+        speed = torqueMapStep(speed, speedAvg, &torqueMap); // Speed-dependent torque map and launch control
+        #endif
       }
       #endif
 
+      #ifdef CRUISE_PI_ENABLE
+        speed = cruisePIStep(speed, speedAvg, ctrlModReq == SPD_MODE, rtP_Left.n_max, &cruisePI); // Closed-loop cruise control in the active mode
+      #endif
+
       #if defined(TANK_STEERING) && !defined(VARIANT_HOVERCAR) && !defined(VARIANT_SKATEBOARD) 
         // Tank steering (no mixing)
         cmdL = steer; 
@@ -350,6 +414,10 @@ int main(void) {
         mixerFcn(speed << 4, steer << 4, &cmdR, &cmdL);   // This function implements the equations above
       #endif
 
+      #ifdef BALANCE_ENABLE
+        balanceCtrl(&cmdL, &cmdR);                        // Self-balancing: the commands become the speed targets, the outputs are torques
+      #endif
+
 
       // ####### SET OUTPUTS (if the target change is less than +/- 100) #######
       #ifdef INVERT_R_DIRECTION
@@ -366,12 +434,15 @@ int main(void) {
 
     #ifdef VARIANT_TRANSPOTTER
       distance    = CLAMP(input1[inIdx].cmd - 180, 0, 4095);
-      steering    = (input2[inIdx].cmd - 2048) / 2048.0;
-      distanceErr = distance - (int)(setDistance * 1345);
+      steering    = input2[inIdx].cmd - 2048;
+      distanceErr = distance - (int16_t)((int32_t)setDistance * DIST_CNT_PER_M / 1000);
 
       if (nunchuk_connected == 0) {
-        cmdL = cmdL * 0.8f + (CLAMP(distanceErr + (steering*((float)MAX(ABS(distanceErr), 50)) * ROT_P), -850, 850) * -0.2f);
-        cmdR = cmdR * 0.8f + (CLAMP(distanceErr - (steering*((float)MAX(ABS(distanceErr), 50)) * ROT_P), -850, 850) * -0.2f);
+        // Steering term = steering * MAX(|err|, 50) * ROT_P, shifted by 11 (steering) and 8 (ROT_P) bits
+        // The filter cmd = 0.8*cmd - 0.2*x is computed as (4*cmd - x) / 5, truncated toward zero like the float cast
+        int32_t steerTerm = ((((int32_t)steering * MAX(ABS(distanceErr), 50)) >> 11) * ROT_P) >> 8;
+        cmdL = (int16_t)((4 * (int32_t)cmdL - CLAMP(distanceErr + steerTerm, -850, 850)) / 5);
+        cmdR = (int16_t)((4 * (int32_t)cmdR - CLAMP(distanceErr - steerTerm, -850, 850)) / 5);
         if (distanceErr > 0) {
           enable = 1;
         }
@@ -406,15 +477,16 @@ int main(void) {
         pwmr = 0;
         enable = 0;
         #ifdef SUPPORT_LCD
-          LCD_SetLocation(&lcd,  0, 0); LCD_WriteString(&lcd, "Len:");
-          LCD_SetLocation(&lcd,  8, 0); LCD_WriteString(&lcd, "m(");
-          LCD_SetLocation(&lcd, 14, 0); LCD_WriteString(&lcd, "m)");
+          LCD_FB_SetLocation(&lcd,  0, 0); LCD_FB_WriteString(&lcd, "Len:");
+          LCD_FB_SetLocation(&lcd,  8, 0); LCD_FB_WriteString(&lcd, "m(");
+          LCD_FB_SetLocation(&lcd, 14, 0); LCD_FB_WriteString(&lcd, "m)");
         #endif
         HAL_Delay(1000);
         nunchuk_connected = 0;
       }
 
-      if ((distance / 1345.0) - setDistance > 0.5 && (lastDistance / 1345.0) - setDistance > 0.5) { // Error, robot too far away!
+      if ((int32_t)distance     * 1000 > ((int32_t)setDistance + 500) * DIST_CNT_PER_M &&
+          (int32_t)lastDistance * 1000 > ((int32_t)setDistance + 500) * DIST_CNT_PER_M) { // Error, robot too far away! (more than 0.5 m behind)
         enable = 0;
         beepLong(5);
         #ifdef SUPPORT_LCD
@@ -431,15 +503,20 @@ int main(void) {
           if (nunchuk_connected == 0 && enable == 0) {
               if(Nunchuk_Read() == NUNCHUK_CONNECTED) {
                 #ifdef SUPPORT_LCD
-                  LCD_SetLocation(&lcd, 0, 0); LCD_WriteString(&lcd, "Nunchuk Control");
+                  LCD_FB_SetLocation(&lcd, 0, 0); LCD_FB_WriteString(&lcd, "Nunchuk Control");
                 #endif
                 nunchuk_connected = 1;
 	      }
-	    } else {
+	    } else if (Nunchuk_Read() != NUNCHUK_CONNECTED) {
               nunchuk_connected = 0;
 	    }
-          }
         }   
+        if (nunchuk_connected) {                            // Nunchuk buttons (active low) step the follow distance: C = -, Z = +
+          uint8_t nunchukBtn = ~nunchuk_data[5] & 0x03;
+          if ((nunchukBtn & 0x01) && !(nunchukBtnPrev & 0x01)) { setDistanceStep( DIST_STEP); }
+          if ((nunchukBtn & 0x02) && !(nunchukBtnPrev & 0x02)) { setDistanceStep(-DIST_STEP); }
+          nunchukBtnPrev = nunchukBtn;
+        }
       #endif
 
       #ifdef SUPPORT_LCD
@@ -448,13 +525,14 @@ int main(void) {
 
           } else {
             if (nunchuk_connected == 0) {
-              LCD_SetLocation(&lcd,  4, 0); LCD_WriteFloat(&lcd,distance/1345.0,2);
-              LCD_SetLocation(&lcd, 10, 0); LCD_WriteFloat(&lcd,setDistance,2);
+              LCD_FB_SetLocation(&lcd,  4, 0); LCD_FB_WriteFixed(&lcd, distance, DIST_CNT_PER_M, 2);
+              LCD_FB_SetLocation(&lcd, 10, 0); LCD_FB_WriteFixed(&lcd, setDistance, 1000, 2);
             }
-            LCD_SetLocation(&lcd,  4, 1); LCD_WriteFloat(&lcd,batVoltage, 1);
-            // LCD_SetLocation(&lcd, 11, 1); LCD_WriteFloat(&lcd,MAX(ABS(currentR), ABS(currentL)),2);
+            LCD_FB_SetLocation(&lcd,  4, 1); LCD_FB_WriteFixed(&lcd, batVoltageCalib, 100, 1);
+            // LCD_FB_SetLocation(&lcd, 11, 1); LCD_FB_WriteFixed(&lcd, MAX(ABS(currentR), ABS(currentL)), 100, 2);
           }
         }
+        LCD_FB_Update(&lcd);                          // send the changed characters in the background
       #endif
       transpotter_counter++;
     #endif
@@ -479,6 +557,11 @@ int main(void) {
     board_temp_adcFilt  = (int16_t)(board_temp_adcFixdt >> 16);  // convert fixed-point to integer
     board_temp_deg_c    = (TEMP_CAL_HIGH_DEG_C - TEMP_CAL_LOW_DEG_C) * (board_temp_adcFilt - TEMP_CAL_LOW_ADC) / (TEMP_CAL_HIGH_ADC - TEMP_CAL_LOW_ADC) + TEMP_CAL_LOW_DEG_C;
 
+    // ####### LIMITS DERATING #######
+    #ifdef LIM_DERATE
+      derateLimits();                     // Motor thermal model and board temperature: derate i_max (n_max)
+    #endif
+
     // ####### CALC CALIBRATED BATTERY VOLTAGE #######
     batVoltageCalib = batVoltage * BAT_CALIB_REAL_VOLTAGE / BAT_CALIB_ADC;
 
@@ -493,7 +576,7 @@ int main(void) {
         #if defined(DEBUG_SERIAL_PROTOCOL)
           process_debug();
         #else
-          printf("in1:%i in2:%i cmdL:%i cmdR:%i BatADC:%i BatV:%i TempADC:%i Temp:%i \r\n",
+          fmtPrint("in1:%i in2:%i cmdL:%i cmdR:%i BatADC:%i BatV:%i TempADC:%i Temp:%i \r\n",
             input1[inIdx].raw,        // 1: INPUT1
             input2[inIdx].raw,        // 2: INPUT2
             cmdL,                     // 3: output command: [-1000, 1000]
@@ -516,12 +599,25 @@ int main(void) {
         Feedback.speedL_meas	  = (int16_t)rtY_Left.n_mot;
         Feedback.batVoltage	    = (int16_t)batVoltageCalib;
         Feedback.boardTemp	    = (int16_t)board_temp_deg_c;
+        #ifdef MOT_THERM_ENABLE
+        Feedback.motTempL       = motThermLeft.T_wind;
+        Feedback.motTempR       = motThermRight.T_wind;
+        #endif
+        #if TEMP_DERATE_ENABLE
+        Feedback.tempDerate     = tempDerate;
+        #endif
 
         #if defined(FEEDBACK_SERIAL_USART2)
           if(__HAL_DMA_GET_COUNTER(huart2.hdmatx) == 0) {
             Feedback.cmdLed     = (uint16_t)sideboard_leds_L;
             Feedback.checksum   = (uint16_t)(Feedback.start ^ Feedback.cmd1 ^ Feedback.cmd2 ^ Feedback.speedR_meas ^ Feedback.speedL_meas 
                                            ^ Feedback.batVoltage ^ Feedback.boardTemp ^ Feedback.cmdLed);
+            #ifdef MOT_THERM_ENABLE
+            Feedback.checksum  ^= (uint16_t)(Feedback.motTempL ^ Feedback.motTempR);
+            #endif
+            #if TEMP_DERATE_ENABLE
+            Feedback.checksum  ^= Feedback.tempDerate;
+            #endif
 
             HAL_UART_Transmit_DMA(&huart2, (uint8_t *)&Feedback, sizeof(Feedback));
           }
@@ -531,6 +627,12 @@ int main(void) {
             Feedback.cmdLed     = (uint16_t)sideboard_leds_R;
             Feedback.checksum   = (uint16_t)(Feedback.start ^ Feedback.cmd1 ^ Feedback.cmd2 ^ Feedback.speedR_meas ^ Feedback.speedL_meas 
                                            ^ Feedback.batVoltage ^ Feedback.boardTemp ^ Feedback.cmdLed);
+            #ifdef MOT_THERM_ENABLE
+            Feedback.checksum  ^= (uint16_t)(Feedback.motTempL ^ Feedback.motTempR);
+            #endif
+            #if TEMP_DERATE_ENABLE
+            Feedback.checksum  ^= Feedback.tempDerate;
+            #endif
 
             HAL_UART_Transmit_DMA(&huart3, (uint8_t *)&Feedback, sizeof(Feedback));
           }
@@ -544,12 +646,12 @@ int main(void) {
     // ####### BEEP AND EMERGENCY POWEROFF #######
     if (TEMP_POWEROFF_ENABLE && board_temp_deg_c >= TEMP_POWEROFF && speedAvgAbs < 20){  // poweroff before mainboard burns OR low bat 3
       #if defined(DEBUG_SERIAL_USART2) || defined(DEBUG_SERIAL_USART3)
-        printf("Powering off, temperature is too high\r\n");
+        fmtPrint("Powering off, temperature is too high\r\n");
       #endif
       poweroff();
     } else if ( BAT_DEAD_ENABLE && batVoltage < BAT_DEAD && speedAvgAbs < 20){
       #if defined(DEBUG_SERIAL_USART2) || defined(DEBUG_SERIAL_USART3)
-        printf("Powering off, battery voltage is too low\r\n");
+        fmtPrint("Powering off, battery voltage is too low\r\n");
       #endif
       poweroff();
     } else if (rtY_Left.z_errCode || rtY_Right.z_errCode) {                                           // 1 beep (low pitch): Motor error, disable motors
@@ -589,10 +691,15 @@ int main(void) {
         inactivity_timeout_counter = 0;
       }
     #endif
+    #ifdef CRUISE_PI_ENABLE
+      if (abs(cruisePI.n_tgt) > 50 && cruisePI.b_ena) {
+        inactivity_timeout_counter = 0;
+      }
+    #endif
 
     if (inactivity_timeout_counter > (INACTIVITY_TIMEOUT * 60 * 1000) / (DELAY_IN_MAIN_LOOP + 1)) {  // rest of main loop needs maybe 1ms
       #if defined(DEBUG_SERIAL_USART2) || defined(DEBUG_SERIAL_USART3)
-        printf("Powering off, wheels were inactive for too long\r\n");
+        fmtPrint("Powering off, wheels were inactive for too long\r\n");
       #endif
       poweroff();
     }
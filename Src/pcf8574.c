@@ -26,30 +26,43 @@ PCF8574_RESULT PCF8574_Init(PCF8574_HandleTypeDef* handle) {
 }
 
 PCF8574_RESULT PCF8574_DeInit(PCF8574_HandleTypeDef* handle) {
-	HAL_I2C_DeInit(&handle->i2c);
+	HAL_I2C_DeInit(handle->i2c);
 	return PCF8574_OK;
 }
 
 PCF8574_RESULT PCF8574_Write(PCF8574_HandleTypeDef* handle, uint8_t val) {
-	if (HAL_I2C_Master_Transmit(&handle->i2c,
+	uint32_t startTick = HAL_GetTick();
+	while (!PCF8574_IsReady(handle)) {	// let an ongoing asynchronous transfer finish
+		if (HAL_GetTick() - startTick > handle->PCF_I2C_TIMEOUT) {
+			return PCF8574_ERROR;
+		}
+	}
+
+	if (HAL_I2C_Master_Transmit(handle->i2c,
 			(handle->PCF_I2C_ADDRESS << 1) | PCF8574_I2C_ADDRESS_MASK, &val, 1,
 			handle->PCF_I2C_TIMEOUT) != HAL_OK) {
 		//handle->errorCallback(PCF8574_ERROR);
 		return PCF8574_ERROR;
 	}
 
-	/*if (HAL_I2C_Master_Transmit_DMA(&handle->i2c,
-			(handle->PCF_I2C_ADDRESS << 1) | PCF8574_I2C_ADDRESS_MASK, &val, 1) != HAL_OK) {
-		handle->errorCallback(PCF8574_ERROR);
-		//<return PCF8574_ERROR;
-	}*/
+	return PCF8574_OK;
+}
 
-	//HAL_I2C_Master_Transmit_DMA(&hi2c2, 0xA4, (uint8_t*)ai2cBuffer, 2);
+PCF8574_RESULT PCF8574_WriteAsync(PCF8574_HandleTypeDef* handle, uint8_t* buf, uint16_t len) {
+	if (!PCF8574_IsReady(handle) || HAL_I2C_Master_Transmit_DMA(handle->i2c,
+			(handle->PCF_I2C_ADDRESS << 1) | PCF8574_I2C_ADDRESS_MASK, buf, len) != HAL_OK) {
+		return PCF8574_ERROR;
+	}
 	return PCF8574_OK;
 }
 
+uint8_t PCF8574_IsReady(PCF8574_HandleTypeDef* handle) {
+	return HAL_I2C_GetState(handle->i2c) == HAL_I2C_STATE_READY
+			&& !__HAL_I2C_GET_FLAG(handle->i2c, I2C_FLAG_BUSY);	// the nunchuk may hold the bus
+}
+
 PCF8574_RESULT PCF8574_Read(PCF8574_HandleTypeDef* handle, uint8_t* val) {
-	if (HAL_I2C_Master_Receive(&handle->i2c,
+	if (HAL_I2C_Master_Receive(handle->i2c,
 			(handle->PCF_I2C_ADDRESS << 1) | PCF8574_I2C_ADDRESS_MASK, val, 1,
 			handle->PCF_I2C_TIMEOUT) != HAL_OK) {
 		return PCF8574_ERROR;
@@ -41,6 +41,12 @@ pb10 usart3 dma1 channel2/3
 
 TIM_HandleTypeDef htim_right;
 TIM_HandleTypeDef htim_left;
+#ifdef ENCODER_LEFT
+TIM_HandleTypeDef htim_enc_left;
+#endif
+#ifdef ENCODER_RIGHT
+TIM_HandleTypeDef htim_enc_right;
+#endif
 ADC_HandleTypeDef hadc1;
 ADC_HandleTypeDef hadc2;
 I2C_HandleTypeDef hi2c2;
@@ -311,13 +317,13 @@ void I2C_Init(void)
   __HAL_RCC_I2C2_RELEASE_RESET();
   HAL_I2C_Init(&hi2c2);
 
-  /* Peripheral DMA init*/
-/*  __HAL_RCC_DMA1_CLK_ENABLE();
-*/  
+  /* Peripheral DMA init: I2C2 TX is used for the asynchronous LCD updates */
+  __HAL_RCC_DMA1_CLK_ENABLE();
+
   /* DMA1_Channel4_IRQn interrupt configuration */
-/*  HAL_NVIC_SetPriority(DMA1_Channel4_IRQn, 1, 4);
+  HAL_NVIC_SetPriority(DMA1_Channel4_IRQn, 1, 4);
   HAL_NVIC_EnableIRQ(DMA1_Channel4_IRQn);
-*/
+
   /* DMA1_Channel5_IRQn interrupt configuration */
 /*  HAL_NVIC_SetPriority(DMA1_Channel5_IRQn, 1, 3);
   HAL_NVIC_EnableIRQ(DMA1_Channel5_IRQn);
@@ -336,7 +342,7 @@ void I2C_Init(void)
   __HAL_LINKDMA(&hi2c2,hdmarx,hdma_i2c2_rx);
 */
 
-/*  hdma_i2c2_tx.Instance = DMA1_Channel4;
+  hdma_i2c2_tx.Instance = DMA1_Channel4;
   hdma_i2c2_tx.Init.Direction = DMA_MEMORY_TO_PERIPH;
   hdma_i2c2_tx.Init.PeriphInc = DMA_PINC_DISABLE;
   hdma_i2c2_tx.Init.MemInc = DMA_MINC_ENABLE;
@@ -347,13 +353,12 @@ void I2C_Init(void)
   HAL_DMA_Init(&hdma_i2c2_tx);
 
   __HAL_LINKDMA(&hi2c2,hdmatx,hdma_i2c2_tx);
-*/
-  /* Peripheral interrupt init */
-/*  HAL_NVIC_SetPriority(I2C2_EV_IRQn, 0, 0);
+
+  /* Peripheral interrupt init: below the motor control interrupts */
+  HAL_NVIC_SetPriority(I2C2_EV_IRQn, 1, 2);
   HAL_NVIC_EnableIRQ(I2C2_EV_IRQn);
-  HAL_NVIC_SetPriority(I2C2_ER_IRQn, 0, 0);
+  HAL_NVIC_SetPriority(I2C2_ER_IRQn, 1, 3);
   HAL_NVIC_EnableIRQ(I2C2_ER_IRQn);
-*/
 }
 
 void MX_GPIO_Init(void) {
@@ -591,6 +596,68 @@ void MX_TIM_Init(void) {
   __HAL_TIM_ENABLE(&htim_right);
 }
 
+#if defined(ENCODER_LEFT) || defined(ENCODER_RIGHT)
+void Encoder_Init(void) {
+  GPIO_InitTypeDef GPIO_InitStruct;
+  TIM_Encoder_InitTypeDef sEncoderConfig;
+
+  GPIO_InitStruct.Mode  = GPIO_MODE_INPUT;
+  GPIO_InitStruct.Pull  = GPIO_PULLUP;
+  GPIO_InitStruct.Speed = GPIO_SPEED_FREQ_HIGH;
+
+  sEncoderConfig.EncoderMode  = TIM_ENCODERMODE_TI12;     // count on both edges of both channels (x4)
+  sEncoderConfig.IC1Selection = TIM_ICSELECTION_DIRECTTI;
+  sEncoderConfig.IC1Prescaler = TIM_ICPSC_DIV1;
+  sEncoderConfig.IC1Filter    = 6;                        // reject glitches shorter than ~0.5 us
+  sEncoderConfig.IC2Polarity  = TIM_ICPOLARITY_RISING;
+  sEncoderConfig.IC2Selection = TIM_ICSELECTION_DIRECTTI;
+  sEncoderConfig.IC2Prescaler = TIM_ICPSC_DIV1;
+  sEncoderConfig.IC2Filter    = 6;
+
+  #ifdef ENCODER_LEFT
+  LEFT_ENC_TIM_CLK_ENABLE();
+  LEFT_ENC_REMAP();
+  GPIO_InitStruct.Pin = LEFT_ENC_A_PIN;
+  HAL_GPIO_Init(LEFT_ENC_A_PORT, &GPIO_InitStruct);
+  GPIO_InitStruct.Pin = LEFT_ENC_B_PIN;
+  HAL_GPIO_Init(LEFT_ENC_B_PORT, &GPIO_InitStruct);
+
+  htim_enc_left.Instance               = LEFT_ENC_TIM;
+  htim_enc_left.Init.Prescaler         = 0;
+  htim_enc_left.Init.CounterMode       = TIM_COUNTERMODE_UP;
+  htim_enc_left.Init.Period            = ENCODER_CPR - 1;   // wrap once per mechanical revolution
+  htim_enc_left.Init.ClockDivision     = TIM_CLOCKDIVISION_DIV1;
+  htim_enc_left.Init.RepetitionCounter = 0;
+  htim_enc_left.Init.AutoReloadPreload = TIM_AUTORELOAD_PRELOAD_DISABLE;
+  sEncoderConfig.IC1Polarity           = ENCODER_LEFT_POL;
+  HAL_TIM_Encoder_Init(&htim_enc_left, &sEncoderConfig);
+  HAL_TIM_Encoder_Start(&htim_enc_left, TIM_CHANNEL_ALL);
+  #endif
+
+  #ifdef ENCODER_RIGHT
+  RIGHT_ENC_TIM_CLK_ENABLE();
+  #ifdef RIGHT_ENC_REMAP
+  RIGHT_ENC_REMAP();
+  #endif
+  GPIO_InitStruct.Pin = RIGHT_ENC_A_PIN;
+  HAL_GPIO_Init(RIGHT_ENC_A_PORT, &GPIO_InitStruct);
+  GPIO_InitStruct.Pin = RIGHT_ENC_B_PIN;
+  HAL_GPIO_Init(RIGHT_ENC_B_PORT, &GPIO_InitStruct);
+
+  htim_enc_right.Instance               = RIGHT_ENC_TIM;
+  htim_enc_right.Init.Prescaler         = 0;
+  htim_enc_right.Init.CounterMode       = TIM_COUNTERMODE_UP;
+  htim_enc_right.Init.Period            = ENCODER_CPR - 1;
+  htim_enc_right.Init.ClockDivision     = TIM_CLOCKDIVISION_DIV1;
+  htim_enc_right.Init.RepetitionCounter = 0;
+  htim_enc_right.Init.AutoReloadPreload = TIM_AUTORELOAD_PRELOAD_DISABLE;
+  sEncoderConfig.IC1Polarity            = ENCODER_RIGHT_POL;
+  HAL_TIM_Encoder_Init(&htim_enc_right, &sEncoderConfig);
+  HAL_TIM_Encoder_Start(&htim_enc_right, TIM_CHANNEL_ALL);
+  #endif
+}
+#endif
+
 void MX_ADC1_Init(void) {
   ADC_MultiModeTypeDef multimode;
   ADC_ChannelConfTypeDef sConfig;
@@ -191,14 +191,13 @@ void SysTick_Handler(void) {
   /* USER CODE END SysTick_IRQn 1 */
 }
 
-#ifdef CONTROL_NUNCHUK
-extern I2C_HandleTypeDef hi2c2;
-void I2C1_EV_IRQHandler(void)
+#if defined(CONTROL_NUNCHUK) || defined(SUPPORT_NUNCHUK) || defined(DEBUG_I2C_LCD) || defined(SUPPORT_LCD)
+void I2C2_EV_IRQHandler(void)
 {
   HAL_I2C_EV_IRQHandler(&hi2c2);
 }
 
-void I2C1_ER_IRQHandler(void)
+void I2C2_ER_IRQHandler(void)
 {
   HAL_I2C_ER_IRQHandler(&hi2c2);
 }
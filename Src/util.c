@@ -18,7 +18,6 @@
 */
 
 // Includes
-#include <stdio.h>
 #include <stdlib.h> // for abs()
 #include <string.h>
 #include "stm32f1xx_hal.h"
@@ -30,6 +29,7 @@
 #include "BLDC_controller.h"
 #include "rtwtypes.h"
 #include "comms.h"
+#include "format.h"
 
 #if defined(DEBUG_I2C_LCD) || defined(SUPPORT_LCD)
 #include "hd44780.h"
@@ -53,6 +53,26 @@ extern uint8_t buzzerPattern;           // global variable for the buzzer patter
 
 extern uint8_t enable;                  // global variable for motor enable
 
+#if TEMP_DERATE_ENABLE
+extern int16_t board_temp_deg_c;        // global variable for calibrated temperature in degrees Celsius
+#endif
+
+#ifdef HALL_CALIB_ENABLE
+extern volatile uint8_t hallCalibMot;   // motor in hall calibration: 0 = none, 1 = left, 2 = right
+extern volatile uint8_t hallCalibIdx;   // voltage vector angle index [0, 179] in 2 deg steps
+extern volatile int16_t hallCalibVolt;  // voltage vector amplitude
+#endif
+
+#ifdef RIPPLE_COMP_ENABLE
+extern volatile int pwml;               // global variable for pwm left. -1000 to 1000
+extern volatile int pwmr;               // global variable for pwm right. -1000 to 1000
+extern volatile uint8_t rippleLearnEna; // ripple learning: accumulate iq per angle in the DMA ISR
+#endif
+
+#ifdef HILL_HOLD_ENABLE
+extern volatile uint8_t hillHoldReq;    // hill hold request, latched in the DMA ISR
+#endif
+
 extern uint8_t nunchuk_data[6];
 extern volatile uint32_t timeoutCntGen; // global counter for general timeout counter
 extern volatile uint8_t  timeoutFlgGen; // global flag for general timeout counter
@@ -89,6 +109,72 @@ ExtU     rtU_Right;                     /* External inputs */
 ExtY     rtY_Right;                     /* External outputs */
 //---------------
 
+#ifdef GAIN_SCHED_ENABLE
+GainSched gainSched   = { {GAIN_SCHED_N1,  GAIN_SCHED_N2,  GAIN_SCHED_N3},
+                          {GAIN_SCHED_KP1, GAIN_SCHED_KP2, GAIN_SCHED_KP3},
+                          {GAIN_SCHED_KI1, GAIN_SCHED_KI2, GAIN_SCHED_KI3} };
+#endif
+
+#ifdef BIQUAD_ENABLE
+Biquad biquadSpeed    = { BIQUAD_SPD_TYP, BIQUAD_SPD_FC, BIQUAD_SPD_Q };   // Coefficients are set by Biquad_Init()
+Biquad biquadSteer    = { BIQUAD_STR_TYP, BIQUAD_STR_FC, BIQUAD_STR_Q };
+#endif
+
+#ifdef STEER_SCHED_ENABLE
+SteerSched steerSched = { {STEER_SCHED_N1, STEER_SCHED_N2, STEER_SCHED_N3},
+                          {STEER_SCHED_R1, STEER_SCHED_R2, STEER_SCHED_R3} };
+#endif
+
+#ifdef HALL_CALIB_ENABLE
+HallCalib hallCalibLeft  = { {0, 1, 2, 3, 4, 5, 6, 7}, 0 };  // Identity hall mapping until a calibration is loaded
+HallCalib hallCalibRight = { {0, 1, 2, 3, 4, 5, 6, 7}, 0 };
+#endif
+
+#ifdef RIPPLE_COMP_ENABLE
+RippleComp rippleLeft;                  // Ripple compensation tables, zero until learned or loaded
+RippleComp rippleRight;
+uint16_t   rippleGain = RIPPLE_COMP_GAIN; // Ripple compensation gain [%]
+#endif
+
+#ifdef MOT_THERM_ENABLE
+MotTherm  motThermLeft  = { (MOT_THERM_I_CONT * A2BIT_CONV) << 4, MOT_THERM_TAU, 1000 / DELAY_IN_MAIN_LOOP, MOT_THERM_T_AMB,
+                            MOT_THERM_T_START, MOT_THERM_T_MAX, 0, 0, 0, MOT_THERM_T_AMB, 32768 };
+MotTherm  motThermRight = { (MOT_THERM_I_CONT * A2BIT_CONV) << 4, MOT_THERM_TAU, 1000 / DELAY_IN_MAIN_LOOP, MOT_THERM_T_AMB,
+                            MOT_THERM_T_START, MOT_THERM_T_MAX, 0, 0, 0, MOT_THERM_T_AMB, 32768 };
+#endif
+#ifdef LIM_DERATE
+LimDerate iMaxDerLeft   = { (I_MOT_MAX * A2BIT_CONV) << 4, 0 };   // Nominal i_max, taken over from rtP at the first derating step
+LimDerate iMaxDerRight  = { (I_MOT_MAX * A2BIT_CONV) << 4, 0 };
+#endif
+#if TEMP_DERATE_ENABLE && TEMP_DERATE_SPEED
+LimDerate nMaxDerLeft   = { N_MOT_MAX << 4, 0 };                  // Nominal n_max
+LimDerate nMaxDerRight  = { N_MOT_MAX << 4, 0 };
+#endif
+#if TEMP_DERATE_ENABLE
+uint16_t  tempDerate    = 32768;        // Board temperature derating factor in fixdt(0,16,15)
+#endif
+
+#ifdef BALANCE_ENABLE
+BalanceCtrl balanceLeft  = {BAL_KP_N, BAL_KI_N, BAL_KP_P, BAL_KP_R, BAL_PITCH_SP_MAX, BAL_PITCH_START, BAL_PITCH_MAX, BAL_SOFT_TIME, 0, 0, 0, 0};
+BalanceCtrl balanceRight = {BAL_KP_N, BAL_KI_N, BAL_KP_P, BAL_KP_R, BAL_PITCH_SP_MAX, BAL_PITCH_START, BAL_PITCH_MAX, BAL_SOFT_TIME, 0, 0, 0, 0};
+#endif
+#ifdef CRUISE_PI_ENABLE
+CruisePI cruisePI     = {CRUISE_KP, CRUISE_KI, CRUISE_RELEASE, 0, 0, 0, 0, 0, 0}; // Vehicle speed PI, stepped in the main loop
+#endif
+#ifdef TORQUE_MAP_ENABLE
+TorqueMap torqueMap   = { {TORQUE_MAP_N1, TORQUE_MAP_N2, TORQUE_MAP_N3, TORQUE_MAP_N4},
+                          {TORQUE_MAP_R1, TORQUE_MAP_R2, TORQUE_MAP_R3, TORQUE_MAP_R4},
+                          (TORQUE_LAUNCH_RATE * DELAY_IN_MAIN_LOOP * 16) / 1000, TORQUE_LAUNCH_N_END, 0, 1 };
+#endif
+
+#if defined(POSITION_CONTROL) || defined(HILL_HOLD_ENABLE)
+PosCtrl  posCtrlLeft  = {0, 0, -1, POS_SPD_MAX, 0, 1};  // Left wheel position control, stepped in the DMA ISR
+PosCtrl  posCtrlRight = {0, 0, -1, POS_SPD_MAX, 0, 1};  // Right wheel position control, stepped in the DMA ISR
+#endif
+#ifdef POSITION_CONTROL
+uint16_t posKp        = POS_KP;                         // Position gain in fixdt(0,16,8)
+#endif
+
 uint8_t  inIdx      = 0;
 uint8_t  inIdx_prev = 0;
 #if defined(PRI_INPUT1) && defined(PRI_INPUT2) && defined(AUX_INPUT1) && defined(AUX_INPUT2)
@@ -112,13 +198,20 @@ LCD_PCF8574_HandleTypeDef lcd;
 #endif
 
 #ifdef VARIANT_TRANSPOTTER
-float    setDistance;
+uint16_t setDistance;                             // [mm] follow distance
 uint16_t VirtAddVarTab[NB_OF_VAR] = {1337};       // Virtual address defined by the user: 0xFFFF value is prohibited
 static   uint16_t saveValue       = 0;
 static   uint8_t  saveValue_valid = 0;
 #elif !defined(VARIANT_HOVERBOARD) && !defined(VARIANT_TRANSPOTTER)
 uint16_t VirtAddVarTab[NB_OF_VAR] = {1000, 1001, 1002, 1003, 1004, 1005, 1006, 1007, 1008, 1009,
-                                     1010, 1011, 1012, 1013, 1014, 1015, 1016, 1017, 1018};
+                                     1010, 1011, 1012, 1013, 1014, 1015, 1016, 1017, 1018, 1019,
+                                     1020, 1021, 1022, 1023, 1024, 1025, 1026, 1027, 1028, 1029,
+                                     1030, 1031, 1032, 1033, 1034, 1035, 1036, 1037, 1038, 1039,
+                                     1040, 1041, 1042, 1043, 1044, 1045, 1046, 1047, 1048, 1049,
+                                     1050, 1051, 1052, 1053, 1054, 1055, 1056, 1057, 1058, 1059,
+                                     1060, 1061, 1062, 1063, 1064, 1065, 1066, 1067, 1068, 1069,
+                                     1070, 1071, 1072, 1073, 1074, 1075, 1076, 1077, 1078, 1079,
+                                     1080, 1081};
 #else
 uint16_t VirtAddVarTab[NB_OF_VAR] = {1000};       // Dummy virtual address to avoid warnings
 #endif
@@ -172,6 +265,10 @@ static uint32_t Sideboard_R_len = sizeof(Sideboard_R);
 static SerialCommand commandL;
 static SerialCommand commandL_raw;
 static uint32_t commandL_len = sizeof(commandL);
+  #ifdef POSITION_CONTROL
+  static SerialPosition positionL_raw;
+  static uint32_t positionL_len = sizeof(positionL_raw);
+  #endif
   #ifdef CONTROL_IBUS
   static uint16_t ibusL_captured_value[IBUS_NUM_CHANNELS];
   #endif
@@ -181,6 +278,10 @@ static uint32_t commandL_len = sizeof(commandL);
 static SerialCommand commandR;
 static SerialCommand commandR_raw;
 static uint32_t commandR_len = sizeof(commandR);
+  #ifdef POSITION_CONTROL
+  static SerialPosition positionR_raw;
+  static uint32_t positionR_len = sizeof(positionR_raw);
+  #endif
   #ifdef CONTROL_IBUS
   static uint16_t ibusR_captured_value[IBUS_NUM_CHANNELS];
   #endif
@@ -200,33 +301,7 @@ static uint8_t cruiseCtrlAcv = 0;
 static uint8_t standstillAcv = 0;
 #endif
 
-/* =========================== Retargeting printf =========================== */
-/* retarget the C library printf function to the USART */
-#if defined(DEBUG_SERIAL_USART2) || defined(DEBUG_SERIAL_USART3)
-  #ifdef __GNUC__
-    #define PUTCHAR_PROTOTYPE int __io_putchar(int ch)
-  #else
-    #define PUTCHAR_PROTOTYPE int fputc(int ch, FILE *f)
-  #endif
-  PUTCHAR_PROTOTYPE {
-    #if defined(DEBUG_SERIAL_USART2)
-      HAL_UART_Transmit(&huart2, (uint8_t *)&ch, 1, 1000);
-    #elif defined(DEBUG_SERIAL_USART3)
-      HAL_UART_Transmit(&huart3, (uint8_t *)&ch, 1, 1000);
-    #endif
-    return ch;
-  }
-  
-  #ifdef __GNUC__
-    int _write(int file, char *data, int len) {
-      int i;
-      for (i = 0; i < len; i++) { __io_putchar( *data++ );}
-      return len;
-    }
-  #endif
-#endif
 
- 
 /* =========================== Initialization Functions =========================== */
 
 void BLDC_Init(void) {
@@ -299,12 +374,18 @@ void Input_Init(void) {
 
   #if !defined(VARIANT_HOVERBOARD) && !defined(VARIANT_TRANSPOTTER)
     uint16_t writeCheck, readVal;
+    #ifdef INPUT_CURVE_ENABLE
+    for (uint8_t i=0; i<INPUTS_NR; i++) {
+      input1[i].expo = INPUT1_EXPO;
+      input2[i].expo = INPUT2_EXPO;
+    }
+    #endif
     HAL_FLASH_Unlock();
     EE_Init();            /* EEPROM Init */
     EE_ReadVariable(VirtAddVarTab[0], &writeCheck);
     if (writeCheck == FLASH_WRITE_KEY) {
       #if defined(DEBUG_SERIAL_USART2) || defined(DEBUG_SERIAL_USART3)
-        printf("Using the configuration from EEprom\r\n");
+        fmtPrint("Using the configuration from EEprom\r\n");
       #endif
 
       EE_ReadVariable(VirtAddVarTab[1] , &readVal); rtP_Left.i_max = rtP_Right.i_max = (int16_t)readVal;
@@ -319,13 +400,32 @@ void Input_Init(void) {
         EE_ReadVariable(VirtAddVarTab[ 9+8*i] , &readVal); input2[i].mid = (int16_t)readVal;
         EE_ReadVariable(VirtAddVarTab[10+8*i] , &readVal); input2[i].max = (int16_t)readVal;
       
-        printf("Limits Input1: TYP:%i MIN:%i MID:%i MAX:%i\r\nLimits Input2: TYP:%i MIN:%i MID:%i MAX:%i\r\n",
+        fmtPrint("Limits Input1: TYP:%i MIN:%i MID:%i MAX:%i\r\nLimits Input2: TYP:%i MIN:%i MID:%i MAX:%i\r\n",
           input1[i].typ, input1[i].min, input1[i].mid, input1[i].max,
           input2[i].typ, input2[i].min, input2[i].mid, input2[i].max);
       }
+      #ifdef INPUT_CURVE_ENABLE
+      for (uint8_t i=0; i<INPUTS_NR; i++) {   // Keep the config.h values if they were never saved
+        if (EE_ReadVariable(VirtAddVarTab[72+2*i] , &readVal) == 0) { input1[i].expo = (int16_t)readVal; }
+        if (EE_ReadVariable(VirtAddVarTab[73+2*i] , &readVal) == 0) { input2[i].expo = (int16_t)readVal; }
+      }
+      #endif
+      #ifdef GAIN_SCHED_ENABLE
+      for (uint8_t i=0; i<3; i++) {   // Keep the config.h values if they were never saved (EEPROM written by an older firmware)
+        if (EE_ReadVariable(VirtAddVarTab[19+i] , &readVal) == 0) { gainSched.n[i]  = (int16_t)readVal; }
+        if (EE_ReadVariable(VirtAddVarTab[22+i] , &readVal) == 0) { gainSched.kp[i] = readVal; }
+        if (EE_ReadVariable(VirtAddVarTab[25+i] , &readVal) == 0) { gainSched.ki[i] = readVal; }
+      }
+      #endif
+      #ifdef STEER_SCHED_ENABLE
+      for (uint8_t i=0; i<3; i++) {   // Keep the config.h values if they were never saved
+        if (EE_ReadVariable(VirtAddVarTab[76+i] , &readVal) == 0) { steerSched.n[i] = (int16_t)readVal; }
+        if (EE_ReadVariable(VirtAddVarTab[79+i] , &readVal) == 0) { steerSched.r[i] = readVal; }
+      }
+      #endif
     } else {
       #if defined(DEBUG_SERIAL_USART2) || defined(DEBUG_SERIAL_USART3)
-        printf("Using the configuration from config.h\r\n");
+        fmtPrint("Using the configuration from config.h\r\n");
       #endif
 
       for (uint8_t i=0; i<INPUTS_NR; i++) {
@@ -339,25 +439,71 @@ void Input_Init(void) {
         } else {
           input2[i].typ = input2[i].typDef;
         }
-        printf("Limits Input1: TYP:%i MIN:%i MID:%i MAX:%i\r\nLimits Input2: TYP:%i MIN:%i MID:%i MAX:%i\r\n",
+        fmtPrint("Limits Input1: TYP:%i MIN:%i MID:%i MAX:%i\r\nLimits Input2: TYP:%i MIN:%i MID:%i MAX:%i\r\n",
           input1[i].typ, input1[i].min, input1[i].mid, input1[i].max,
           input2[i].typ, input2[i].min, input2[i].mid, input2[i].max);
       }
     }
+
+    #ifdef HALL_CALIB_ENABLE
+    // Hall calibrations are saved by hallCalib() directly, hence they do not depend on the write key
+    uint16_t readMap0, readMap1;
+    for (uint8_t i=0; i<2; i++) {
+      HallCalib *hc = i ? &hallCalibRight : &hallCalibLeft;
+      if (EE_ReadVariable(VirtAddVarTab[28+3*i] , &readMap0) == 0 &&
+          EE_ReadVariable(VirtAddVarTab[29+3*i] , &readMap1) == 0 &&
+          EE_ReadVariable(VirtAddVarTab[30+3*i] , &readVal)  == 0 && (readMap1 >> 8) == HALL_CALIB_KEY) {
+        hc->z_map[1] = (uint8_t)( readMap0        & 0x7);
+        hc->z_map[2] = (uint8_t)((readMap0 >>  4) & 0x7);
+        hc->z_map[3] = (uint8_t)((readMap0 >>  8) & 0x7);
+        hc->z_map[4] = (uint8_t)((readMap0 >> 12) & 0x7);
+        hc->z_map[5] = (uint8_t)( readMap1        & 0x7);
+        hc->z_map[6] = (uint8_t)((readMap1 >>  4) & 0x7);
+        hc->a_offset = (int16_t)readVal;
+        #if defined(DEBUG_SERIAL_USART2) || defined(DEBUG_SERIAL_USART3)
+          fmtPrint("Hall calibration %s: MAP:%i%i%i%i%i%i OFFSET:%i\r\n", i ? "Right" : "Left",
+            hc->z_map[1], hc->z_map[2], hc->z_map[3], hc->z_map[4], hc->z_map[5], hc->z_map[6], hc->a_offset);
+        #endif
+      }
+    }
+    #endif
+
+    #ifdef RIPPLE_COMP_ENABLE
+    // Ripple tables are saved by rippleLearn() directly: marker, then 2 points per word
+    for (uint8_t i=0; i<2; i++) {
+      RippleComp *rc = i ? &rippleRight : &rippleLeft;
+      if (EE_ReadVariable(VirtAddVarTab[34+19*i] , &readVal) == 0 && readVal == ((RIPPLE_COMP_KEY << 8) | RIPPLE_COMP_BINS)) {
+        for (uint8_t j=0; j<RIPPLE_COMP_BINS/2; j++) {
+          EE_ReadVariable(VirtAddVarTab[35+19*i+j] , &readVal);
+          rc->r_comp[2*j]   = (int8_t)(readVal & 0xFF);
+          rc->r_comp[2*j+1] = (int8_t)(readVal >> 8);
+        }
+        #if defined(DEBUG_SERIAL_USART2) || defined(DEBUG_SERIAL_USART3)
+          fmtPrint("Ripple compensation %s loaded\r\n", i ? "Right" : "Left");
+        #endif
+      }
+    }
+    #endif
     HAL_FLASH_Lock();
   #endif
 
   #ifdef VARIANT_TRANSPOTTER
     enable = 1;
 
+    #ifdef INPUT_CURVE_ENABLE
+    for (uint8_t i=0; i<INPUTS_NR; i++) {
+      input1[i].expo = INPUT1_EXPO;
+      input2[i].expo = INPUT2_EXPO;
+    }
+    #endif
     HAL_FLASH_Unlock();
     EE_Init();            /* EEPROM Init */
     EE_ReadVariable(VirtAddVarTab[0], &saveValue);
     HAL_FLASH_Lock();
 
-    setDistance = saveValue / 1000.0;
-    if (setDistance < 0.2) {
-      setDistance = 1.0;
+    setDistance = saveValue;                        // saved in [mm]
+    if (setDistance < 200) {
+      setDistance = 1000;
     }
   #endif
 
@@ -366,7 +512,7 @@ void Input_Init(void) {
     HAL_Delay(50);
     lcd.pcf8574.PCF_I2C_ADDRESS = 0x27;
     lcd.pcf8574.PCF_I2C_TIMEOUT = 5;
-    lcd.pcf8574.i2c             = hi2c2;
+    lcd.pcf8574.i2c             = &hi2c2;
     lcd.NUMBER_OF_LINES         = NUMBER_OF_LINES_2;
     lcd.type                    = TYPE0;
 
@@ -389,15 +535,22 @@ void Input_Init(void) {
   #if defined(VARIANT_TRANSPOTTER) && defined(SUPPORT_LCD)
     LCD_ClearDisplay(&lcd);
     HAL_Delay(5);
-    LCD_SetLocation(&lcd,  0, 1); LCD_WriteString(&lcd, "Bat:");
-    LCD_SetLocation(&lcd,  8, 1); LCD_WriteString(&lcd, "V");
-    LCD_SetLocation(&lcd, 15, 1); LCD_WriteString(&lcd, "A");
-    LCD_SetLocation(&lcd,  0, 0); LCD_WriteString(&lcd, "Len:");
-    LCD_SetLocation(&lcd,  8, 0); LCD_WriteString(&lcd, "m(");
-    LCD_SetLocation(&lcd, 14, 0); LCD_WriteString(&lcd, "m)");
+    LCD_FB_SetLocation(&lcd,  0, 1); LCD_FB_WriteString(&lcd, "Bat:");   // sent by LCD_FB_Update() in the main loop
+    LCD_FB_SetLocation(&lcd,  8, 1); LCD_FB_WriteString(&lcd, "V");
+    LCD_FB_SetLocation(&lcd, 15, 1); LCD_FB_WriteString(&lcd, "A");
+    LCD_FB_SetLocation(&lcd,  0, 0); LCD_FB_WriteString(&lcd, "Len:");
+    LCD_FB_SetLocation(&lcd,  8, 0); LCD_FB_WriteString(&lcd, "m(");
+    LCD_FB_SetLocation(&lcd, 14, 0); LCD_FB_WriteString(&lcd, "m)");
   #endif
 }
 
+#ifdef BIQUAD_ENABLE
+void Biquad_Init(void) {        // (Re)compute the command filter coefficients, also called when they are changed in the debug protocol
+  biquadDesign(1000 / DELAY_IN_MAIN_LOOP, &biquadSpeed);
+  biquadDesign(1000 / DELAY_IN_MAIN_LOOP, &biquadSteer);
+}
+#endif
+
 /**
   * @brief  Disable Rx Errors detection interrupts on UART peripheral (since we do not want DMA to be stopped)
   *         The incorrect data will be filtered based on the START_FRAME and checksum.
@@ -535,7 +688,7 @@ void adcCalibLim(void) {
 #if !defined(VARIANT_HOVERBOARD) && !defined(VARIANT_TRANSPOTTER)
 
   #if defined(DEBUG_SERIAL_USART2) || defined(DEBUG_SERIAL_USART3)
-  printf("Input calibration started...\r\n");
+  fmtPrint("Input calibration started...\r\n");
   #endif
 
   readInputRaw();
@@ -573,32 +726,32 @@ void adcCalibLim(void) {
   }
 
   #if defined(DEBUG_SERIAL_USART2) || defined(DEBUG_SERIAL_USART3)
-  printf("Input1 is ");
+  fmtPrint("Input1 is ");
   #endif
   uint8_t input1TypTemp = checkInputType(INPUT1_MIN_temp, INPUT1_MID_temp, INPUT1_MAX_temp);
   if (input1TypTemp == input1[inIdx].typDef || input1[inIdx].typDef == 3) {  // Accept calibration only if the type is correct OR type was set to 3 (auto)
     #if defined(DEBUG_SERIAL_USART2) || defined(DEBUG_SERIAL_USART3)
-    printf("..OK\r\n");
+    fmtPrint("..OK\r\n");
     #endif
   } else {
     input1TypTemp = 0; // Disable input
     #if defined(DEBUG_SERIAL_USART2) || defined(DEBUG_SERIAL_USART3)
-    printf("..NOK\r\n");
+    fmtPrint("..NOK\r\n");
     #endif
   }
 
   #if defined(DEBUG_SERIAL_USART2) || defined(DEBUG_SERIAL_USART3)
-  printf("Input2 is ");
+  fmtPrint("Input2 is ");
   #endif
   uint8_t input2TypTemp = checkInputType(INPUT2_MIN_temp, INPUT2_MID_temp, INPUT2_MAX_temp);
   if (input2TypTemp == input2[inIdx].typDef || input2[inIdx].typDef == 3) {  // Accept calibration only if the type is correct OR type was set to 3 (auto)
     #if defined(DEBUG_SERIAL_USART2) || defined(DEBUG_SERIAL_USART3)
-    printf("..OK\r\n");
+    fmtPrint("..OK\r\n");
     #endif
   } else {
     input2TypTemp = 0; // Disable input
     #if defined(DEBUG_SERIAL_USART2) || defined(DEBUG_SERIAL_USART3)
-    printf("..NOK\r\n");
+    fmtPrint("..NOK\r\n");
     #endif
   }
 
@@ -617,13 +770,13 @@ void adcCalibLim(void) {
 
     inp_cal_valid = 1;    // Mark calibration to be saved in Flash at shutdown
     #if defined(DEBUG_SERIAL_USART2) || defined(DEBUG_SERIAL_USART3)
-    printf("Limits Input1: TYP:%i MIN:%i MID:%i MAX:%i\r\nLimits Input2: TYP:%i MIN:%i MID:%i MAX:%i\r\n",
+    fmtPrint("Limits Input1: TYP:%i MIN:%i MID:%i MAX:%i\r\nLimits Input2: TYP:%i MIN:%i MID:%i MAX:%i\r\n",
             input1[inIdx].typ, input1[inIdx].min, input1[inIdx].mid, input1[inIdx].max,
             input2[inIdx].typ, input2[inIdx].min, input2[inIdx].mid, input2[inIdx].max);
     #endif
   }else{
     #if defined(DEBUG_SERIAL_USART2) || defined(DEBUG_SERIAL_USART3)
-    printf("Both inputs cannot be ignored, calibration rejected.\r\n");
+    fmtPrint("Both inputs cannot be ignored, calibration rejected.\r\n");
     #endif
   }
 
@@ -646,7 +799,7 @@ void updateCurSpdLim(void) {
 #if !defined(VARIANT_HOVERBOARD) && !defined(VARIANT_TRANSPOTTER)
 
   #if defined(DEBUG_SERIAL_USART2) || defined(DEBUG_SERIAL_USART3)
-  printf("Torque and Speed limits update started...\r\n");
+  fmtPrint("Torque and Speed limits update started...\r\n");
   #endif
 
   int32_t  input1_fixdt = input1[inIdx].raw << 16;
@@ -681,7 +834,7 @@ void updateCurSpdLim(void) {
 
   #if defined(DEBUG_SERIAL_USART2) || defined(DEBUG_SERIAL_USART3)
   // cur_spd_valid: 0 = No limit changed, 1 = Current limit changed, 2 = Speed limit changed, 3 = Both limits changed
-  printf("Limits (%i)\r\nCurrent: fixdt:%li factor%i i_max:%i \r\nSpeed: fixdt:%li factor:%i n_max:%i\r\n",
+  fmtPrint("Limits (%i)\r\nCurrent: fixdt:%li factor%i i_max:%i \r\nSpeed: fixdt:%li factor:%i n_max:%i\r\n",
           cur_spd_valid, input1_fixdt, cur_factor, rtP_Left.i_max, input2_fixdt, spd_factor, rtP_Left.n_max);
   #endif
 
@@ -692,12 +845,24 @@ void updateCurSpdLim(void) {
  * Standstill Hold Function
  * This function uses Cruise Control to provide an anti-roll functionality at standstill.
  * Only available and makes sense for FOC VOLTAGE or FOC TORQUE mode.
+ * With HILL_HOLD_ENABLE it requests the position-locked hold instead (FOC TORQUE mode), see hillHoldStep().
  * 
  * Input:  none
- * Output: standstillAcv
+ * Output: standstillAcv or hillHoldReq
  */
 void standstillHold(void) {
-  #if defined(STANDSTILL_HOLD_ENABLE) && (CTRL_TYP_SEL == FOC_CTRL) && (CTRL_MOD_REQ != SPD_MODE)
+  #if defined(HILL_HOLD_ENABLE)
+    if (!hillHoldReq) {                                               // If Hill Hold is NOT requested -> try Activation
+      if (input2[inIdx].cmd < 20 && speedAvgAbs < HILL_HOLD_SPD) {    // Check if Throttle is small AND measured speed is very small
+        hillHoldReq = 1;                                              // the wheel positions are latched in the DMA ISR
+      }
+    }
+    else {                                                            // If Hill Hold is requested -> try Deactivation
+      if (input1[inIdx].cmd < 20 && input2[inIdx].cmd > 50) {         // Check if Brake is released AND Throttle is pressed
+        hillHoldReq = 0;                                              // the hold torque fades out in the DMA ISR
+      }
+    }
+  #elif defined(STANDSTILL_HOLD_ENABLE) && (CTRL_TYP_SEL == FOC_CTRL) && (CTRL_MOD_REQ != SPD_MODE)
     if (!rtP_Left.b_cruiseCtrlEna) {                                  // If Stanstill in NOT Active -> try Activation
       if (((input1[inIdx].cmd > 50 || input2[inIdx].cmd < -50) && speedAvgAbs < 30) // Check if Brake is pressed AND measured speed is small
           || (input2[inIdx].cmd < 20 && speedAvgAbs < 5)) {           // OR Throttle is small AND measured speed is very small
@@ -758,12 +923,25 @@ void electricBrake(uint16_t speedBlend, uint8_t reverseDir) {
  /*
  * Cruise Control Function
  * This function activates/deactivates cruise control.
+ * With CRUISE_PI_ENABLE it engages the vehicle speed PI (cruisePIStep) instead of the controller cruise mode.
  * 
  * Input: button (as a pulse)
  * Output: cruiseCtrlAcv
  */
 void cruiseControl(uint8_t button) {
-  #ifdef CRUISE_CONTROL_SUPPORT
+  #if defined(CRUISE_CONTROL_SUPPORT) && defined(CRUISE_PI_ENABLE)
+    if (button && !cruisePI.b_ena) {                                    // Cruise control activated at the present speed and command
+      cruisePI.n_tgt  = speedAvg;
+      cruisePI.z_int  = (int32_t)cruisePI.r_out * 65536;
+      cruisePI.b_ena  = 1;
+      cruiseCtrlAcv = 1;
+      beepShortMany(2, 1);                                              // 200 ms beep delay. Acts as a debounce also.
+    } else if (button && cruisePI.b_ena) {                              // Cruise control deactivated, the command fades back to the input
+      cruisePI.b_ena  = 0;
+      cruiseCtrlAcv = 0;
+      beepShortMany(2, -1);
+    }
+  #elif defined(CRUISE_CONTROL_SUPPORT)
     if (button && !rtP_Left.b_cruiseCtrlEna) {                          // Cruise control activated
       rtP_Left.n_cruiseMotTgt   = rtY_Left.n_mot;
       rtP_Right.n_cruiseMotTgt  = rtY_Right.n_mot;
@@ -780,6 +958,261 @@ void cruiseControl(uint8_t button) {
   #endif
 }
 
+ /*
+ * Speed Gain Schedule Function
+ * This function interpolates the speed PI gains over the measured speed of each motor.
+ * It is called from the main loop, the 16 kHz controller only sees the updated cf_nKp/cf_nKi.
+ */
+void speedGainSched(void) {
+  #ifdef GAIN_SCHED_ENABLE
+    gainSchedCalc(rtY_Left.n_mot,  &gainSched, &rtP_Left.cf_nKp,  &rtP_Left.cf_nKi);
+    gainSchedCalc(rtY_Right.n_mot, &gainSched, &rtP_Right.cf_nKp, &rtP_Right.cf_nKi);
+  #endif
+}
+
+ /*
+ * Limits Derating Function
+ * This function lowers rtP.i_max of each motor while its winding is hot (motor thermal model) and rtP.i_max,
+ * optionally rtP.n_max, of both motors while the board is hot (TEMP_DERATE_START to TEMP_DERATE_END).
+ * A change of a limit from elsewhere (EEPROM, calibration, drive mode) becomes the new nominal limit.
+ * It is called from the main loop every DELAY_IN_MAIN_LOOP, after the board temperature update.
+ */
+void derateLimits(void) {
+  #ifdef LIM_DERATE
+    uint16_t r_facL = 32768, r_facR = 32768;
+    int16_t  i_minL = 0,     i_minR = 0;
+    uint16_t r_temp = 32768;
+
+    #ifdef MOT_THERM_ENABLE
+      motThermStep(rtY_Left.iq,  rtY_Left.id,  &motThermLeft);
+      motThermStep(rtY_Right.iq, rtY_Right.id, &motThermRight);
+      r_facL = motThermLeft.r_fac;  i_minL = motThermLeft.i_cont;
+      r_facR = motThermRight.r_fac; i_minR = motThermRight.i_cont;
+    #endif
+
+    #if TEMP_DERATE_ENABLE
+      if (board_temp_deg_c <= TEMP_DERATE_START) {
+        r_temp = 32768;
+      } else if (board_temp_deg_c >= TEMP_DERATE_END) {
+        r_temp = TEMP_DERATE_MIN * 32768 / 100;
+      } else {
+        r_temp = (uint16_t)(32768 - (int32_t)(100 - TEMP_DERATE_MIN) * 32768 / 100 * (board_temp_deg_c - TEMP_DERATE_START) / (TEMP_DERATE_END - TEMP_DERATE_START));
+      }
+      tempDerate = r_temp;
+      #if TEMP_DERATE_SPEED
+        rtP_Left.n_max  = limDerate(rtP_Left.n_max,  0, 32768, r_temp, &nMaxDerLeft);
+        rtP_Right.n_max = limDerate(rtP_Right.n_max, 0, 32768, r_temp, &nMaxDerRight);
+      #endif
+    #endif
+
+    rtP_Left.i_max  = limDerate(rtP_Left.i_max,  i_minL, r_facL, r_temp, &iMaxDerLeft);
+    rtP_Right.i_max = limDerate(rtP_Right.i_max, i_minR, r_facR, r_temp, &iMaxDerRight);
+  #endif
+}
+
+ /*
+ * Balance Control Function
+ * This function replaces the wheel commands by the torque targets of the self-balancing controllers (VARIANT_HOVERBOARD).
+ * Each wheel is balanced with the pitch of its own sideboard, the commands are used as speed targets (1000 = n_max).
+ * It is called from the main loop every DELAY_IN_MAIN_LOOP, a sideboard timeout cuts the controller off.
+ *
+ * Input:  cmdL, cmdR = speed targets [-1000, 1000] (vehicle direction)
+ * Output: cmdL, cmdR = torque targets [-1000, 1000] (vehicle direction)
+ */
+void balanceCtrl(int16_t *cmdL, int16_t *cmdR) {
+  #ifdef BALANCE_ENABLE
+    int16_t nL, nR;
+
+    #if defined(INVERT_L_DIRECTION)
+      nL = -rtY_Left.n_mot;
+    #else
+      nL =  rtY_Left.n_mot;
+    #endif
+    #if defined(INVERT_R_DIRECTION)
+      nR =  rtY_Right.n_mot;
+    #else
+      nR = -rtY_Right.n_mot;
+    #endif
+
+    balanceStep(BAL_DIR_L * Sideboard_L.pitch, BAL_DIR_L * Sideboard_L.dPitch, nL, (int16_t)((int32_t)*cmdL * (rtP_Left.n_max >> 4) / 1000),
+                enable && !timeoutFlgSerial_L, &balanceLeft);
+    balanceStep(BAL_DIR_R * Sideboard_R.pitch, BAL_DIR_R * Sideboard_R.dPitch, nR, (int16_t)((int32_t)*cmdR * (rtP_Right.n_max >> 4) / 1000),
+                enable && !timeoutFlgSerial_R, &balanceRight);
+    *cmdL = balanceLeft.r_trq;
+    *cmdR = balanceRight.r_trq;
+  #endif
+}
+
+ /*
+ * Hall Calibration
+ * Procedure (wheels lifted, started via the debug command "HALLCAL"):
+ * - each enabled motor is driven by an open loop voltage vector, slowly rotated HALL_CALIB_REVS electrical revolutions forward and backward
+ * - the raw hall states are recorded per electrical angle, hallCalibCalc() derives the hall mapping and the angle offset
+ * - a valid result is applied immediately and saved to EEPROM (independent of the write key and of saveConfig())
+ * Returns 1 if all enabled motors were calibrated successfully.
+ */
+int8_t hallCalib(void) {
+  int8_t ret = 0;
+#ifdef HALL_CALIB_ENABLE
+  calcAvgSpeed();
+  if (speedAvgAbs > 5) {    // do not enter this mode if motors are spinning
+    return ret;
+  }
+
+  HallCalib hc;
+  int32_t   sumCos[8], sumSin[8];
+  uint16_t  nSteps = HALL_CALIB_REVS * 180;
+  uint8_t   z_hall, z_dir, idx;
+
+  ret = 1;
+  for (uint8_t mot = 1; mot <= 2; mot++) {
+    #ifndef MOTOR_LEFT_ENA
+    if (mot == 1) continue;
+    #endif
+    #ifndef MOTOR_RIGHT_ENA
+    if (mot == 2) continue;
+    #endif
+
+    #if defined(DEBUG_SERIAL_USART2) || defined(DEBUG_SERIAL_USART3)
+    fmtPrint("Hall calibration %s started...\r\n", mot == 1 ? "Left" : "Right");
+    #endif
+
+    memset(sumCos, 0, sizeof(sumCos));
+    memset(sumSin, 0, sizeof(sumSin));
+    hallCalibIdx  = 0;
+    hallCalibVolt = 0;
+    hallCalibMot  = mot;
+    enable        = 1;
+    for (int16_t v = 1; v <= HALL_CALIB_VOLT; v++) {  // ramp up the voltage vector at angle 0
+      hallCalibVolt = v;
+      HAL_Delay(2);
+    }
+    HAL_Delay(500);                                   // let the rotor settle
+
+    for (uint16_t i = 0; i < 2 * nSteps; i++) {       // rotate forward, then backward
+      idx = (uint8_t)((i < nSteps ? i : 2 * nSteps - i) % 180);
+      hallCalibIdx = idx;
+      HAL_Delay(HALL_CALIB_STEP_MS);
+      if (mot == 1) {
+        z_hall = (uint8_t)((!(LEFT_HALL_U_PORT->IDR  & LEFT_HALL_U_PIN)  << 2) + (!(LEFT_HALL_V_PORT->IDR  & LEFT_HALL_V_PIN)  << 1) + !(LEFT_HALL_W_PORT->IDR  & LEFT_HALL_W_PIN));
+      } else {
+        z_hall = (uint8_t)((!(RIGHT_HALL_U_PORT->IDR & RIGHT_HALL_U_PIN) << 2) + (!(RIGHT_HALL_V_PORT->IDR & RIGHT_HALL_V_PIN) << 1) + !(RIGHT_HALL_W_PORT->IDR & RIGHT_HALL_W_PIN));
+      }
+      sumCos[z_hall] += rtConstP.r_cos_M1_Table[idx];
+      sumSin[z_hall] += rtConstP.r_sin_M1_Table[idx];
+    }
+
+    enable        = 0;
+    hallCalibMot  = 0;
+    hallCalibVolt = 0;
+
+    z_dir = hallCalibCalc(sumCos, sumSin, &hc);
+    if (z_dir) {
+      if (mot == 1) { hallCalibLeft = hc; } else { hallCalibRight = hc; }
+      HAL_FLASH_Unlock();
+      EE_WriteVariable(VirtAddVarTab[25+3*mot] , (uint16_t)(hc.z_map[1] | (hc.z_map[2] << 4) | (hc.z_map[3] << 8) | (hc.z_map[4] << 12)));
+      EE_WriteVariable(VirtAddVarTab[26+3*mot] , (uint16_t)(hc.z_map[5] | (hc.z_map[6] << 4) | (HALL_CALIB_KEY << 8)));
+      EE_WriteVariable(VirtAddVarTab[27+3*mot] , (uint16_t)hc.a_offset);
+      HAL_FLASH_Lock();
+      #if defined(DEBUG_SERIAL_USART2) || defined(DEBUG_SERIAL_USART3)
+      fmtPrint("..OK MAP:%i%i%i%i%i%i OFFSET:%i DIR:%s\r\n", hc.z_map[1], hc.z_map[2], hc.z_map[3], hc.z_map[4], hc.z_map[5], hc.z_map[6],
+              hc.a_offset, z_dir == 1 ? "normal" : "reversed");
+      #endif
+    } else {
+      ret = 0;
+      #if defined(DEBUG_SERIAL_USART2) || defined(DEBUG_SERIAL_USART3)
+      fmtPrint("..NOK, check the hall wiring or increase HALL_CALIB_VOLT\r\n");
+      #endif
+    }
+  }
+#endif  // HALL_CALIB_ENABLE
+  return ret;
+}
+
+ /*
+ * Ripple Compensation Learning
+ * Procedure (wheels lifted, started via the debug command "RIPLEARN"):
+ * - both motors run in SPD_MODE at RIPPLE_LEARN_SPD, forward and then backward, for RIPPLE_LEARN_TIME each
+ * - meanwhile the DMA ISR accumulates the measured iq per electrical angle point (rippleLearnStep)
+ * - rippleLearnCalc() converts the iq deviation from its mean into the compensation table, which is applied and saved to EEPROM
+ * Returns 1 if the tables of all enabled motors were learned.
+ */
+int8_t rippleLearn(void) {
+  int8_t ret = 0;
+#ifdef RIPPLE_COMP_ENABLE
+  calcAvgSpeed();
+  if (speedAvgAbs > 5) {    // do not enter this mode if motors are spinning
+    return ret;
+  }
+
+  #if defined(DEBUG_SERIAL_USART2) || defined(DEBUG_SERIAL_USART3)
+  fmtPrint("Ripple learning started...\r\n");
+  #endif
+
+  uint8_t ctrlModReqRawPrev = ctrlModReqRaw;
+  uint8_t ctrlModReqPrev    = ctrlModReq;
+  int16_t r_spdCmd          = (int16_t)((RIPPLE_LEARN_SPD << 4) * 1000 / rtP_Left.n_max);   // speed in rpm to input target
+
+  memset(rippleLeft.z_iqSum,  0, sizeof(rippleLeft.z_iqSum));
+  memset(rippleLeft.z_iqCnt,  0, sizeof(rippleLeft.z_iqCnt));
+  memset(rippleRight.z_iqSum, 0, sizeof(rippleRight.z_iqSum));
+  memset(rippleRight.z_iqCnt, 0, sizeof(rippleRight.z_iqCnt));
+  ctrlModReqRaw = ctrlModReq = SPD_MODE;
+  enable        = 1;
+  for (int8_t dir = 1; dir >= -1; dir -= 2) {
+    pwml = pwmr = dir * r_spdCmd;
+    HAL_Delay(2000);                                  // reach a constant speed
+    rippleLearnEna = 1;
+    HAL_Delay(RIPPLE_LEARN_TIME);
+    rippleLearnEna = 0;
+  }
+  pwml = pwmr = 0;
+  HAL_Delay(1000);
+  enable        = 0;
+  ctrlModReqRaw = ctrlModReqRawPrev;
+  ctrlModReq    = ctrlModReqPrev;
+
+  if (rtY_Left.z_errCode || rtY_Right.z_errCode) {
+    #if defined(DEBUG_SERIAL_USART2) || defined(DEBUG_SERIAL_USART3)
+    fmtPrint("..NOK, motor error %i %i\r\n", rtY_Left.z_errCode, rtY_Right.z_errCode);
+    #endif
+    return ret;
+  }
+
+  ret = 1;
+  HAL_FLASH_Unlock();
+  for (uint8_t i=0; i<2; i++) {
+    #ifndef MOTOR_LEFT_ENA
+    if (i == 0) continue;
+    #endif
+    #ifndef MOTOR_RIGHT_ENA
+    if (i == 1) continue;
+    #endif
+    RippleComp *rc = i ? &rippleRight : &rippleLeft;
+    if (rippleLearnCalc(rtP_Left.i_max, rc)) {
+      EE_WriteVariable(VirtAddVarTab[34+19*i] , (uint16_t)((RIPPLE_COMP_KEY << 8) | RIPPLE_COMP_BINS));
+      for (uint8_t j=0; j<RIPPLE_COMP_BINS/2; j++) {
+        EE_WriteVariable(VirtAddVarTab[35+19*i+j] , (uint16_t)((uint8_t)rc->r_comp[2*j] | ((uint8_t)rc->r_comp[2*j+1] << 8)));
+      }
+      #if defined(DEBUG_SERIAL_USART2) || defined(DEBUG_SERIAL_USART3)
+      fmtPrint("Ripple %s ..OK\r\n", i ? "Right" : "Left");
+      for (uint8_t j=0; j<RIPPLE_COMP_BINS; j++) {
+        fmtPrint("%i ", rc->r_comp[j]);
+      }
+      fmtPrint("\r\n");
+      #endif
+    } else {
+      ret = 0;
+      #if defined(DEBUG_SERIAL_USART2) || defined(DEBUG_SERIAL_USART3)
+      fmtPrint("Ripple %s ..NOK, not all angles were seen\r\n", i ? "Right" : "Left");
+      #endif
+    }
+  }
+  HAL_FLASH_Lock();
+#endif  // RIPPLE_COMP_ENABLE
+  return ret;
+}
+
  /*
  * Check Input Type
  * This function identifies the input type: 0: Disabled, 1: Normal Pot, 2: Middle Resting Pot
@@ -796,25 +1229,25 @@ int checkInputType(int16_t min, int16_t mid, int16_t max){
   if ((min / threshold) == (max / threshold) || (mid / threshold) == (max / threshold) || min > max || mid > max) {
     type = 0;
     #if defined(DEBUG_SERIAL_USART2) || defined(DEBUG_SERIAL_USART3)
-    printf("ignored");                // (MIN and MAX) OR (MID and MAX) are close, disable input
+    fmtPrint("ignored");                // (MIN and MAX) OR (MID and MAX) are close, disable input
     #endif
   } else {
     if ((min / threshold) == (mid / threshold)){
       type = 1;
       #if defined(DEBUG_SERIAL_USART2) || defined(DEBUG_SERIAL_USART3)
-      printf("a normal pot");        // MIN and MID are close, it's a normal pot
+      fmtPrint("a normal pot");        // MIN and MID are close, it's a normal pot
       #endif
     } else {
       type = 2;
       #if defined(DEBUG_SERIAL_USART2) || defined(DEBUG_SERIAL_USART3)
-      printf("a mid-resting pot");   // it's a mid resting pot
+      fmtPrint("a mid-resting pot");   // it's a mid resting pot
       #endif
     }
 
     #ifdef CONTROL_ADC
     if ((min + ADC_MARGIN - ADC_PROTECT_THRESH) > 0 && (max - ADC_MARGIN + ADC_PROTECT_THRESH) < 4095) {
       #if defined(DEBUG_SERIAL_USART2) || defined(DEBUG_SERIAL_USART3)
-      printf(" AND protected");
+      fmtPrint(" AND protected");
       #endif
       beepLong(2); // Indicate protection by a beep
     }
@@ -828,9 +1261,27 @@ int checkInputType(int16_t min, int16_t mid, int16_t max){
 
 /* =========================== Input Functions =========================== */
 
+ /*
+ * Input Response Curve
+ * This function applies the expo curve y = x * ((100 - expo) + expo * x^2) / 100 to x in [-x_max, x_max]
+ */
+int16_t inputCurve(int16_t x, int16_t x_max, int16_t expo) {
+  int32_t x_n;
+
+  if (x_max <= 0 || expo <= 0) {
+    return x;
+  }
+  x_n = ((int32_t)ABS(x) << 15) / x_max;                                   // normalized input in fixdt(0,16,15)
+  x_n = MIN(x_n, 32768);
+  x_n = (int32_t)(((int64_t)x_n * ((100 - expo) * 32768 + expo * ((x_n * x_n) >> 15)) / 100) >> 15);
+  x_n = (x_n * x_max) >> 15;
+  return (int16_t)((x < 0) ? -x_n : x_n);
+}
+
  /*
  * Calculate Input Command
  * This function realizes dead-band around 0 and scales the input between [out_min, out_max]
+ * With INPUT_CURVE_ENABLE the response curve of the input is applied on the scaled command
  */
 void calcInputCmd(InputStruct *in, int16_t out_min, int16_t out_max) {
   switch (in->typ){
@@ -850,6 +1301,9 @@ void calcInputCmd(InputStruct *in, int16_t out_min, int16_t out_max) {
       in->cmd = 0;
       break;
   }
+  #ifdef INPUT_CURVE_ENABLE
+    in->cmd = inputCurve(in->cmd, (in->cmd < 0) ? -out_min : out_max, in->expo);
+  #endif
 }
 
  /*
@@ -870,10 +1324,12 @@ void readInputRaw(void) {
 
     #if defined(CONTROL_NUNCHUK) || defined(SUPPORT_NUNCHUK)
     if (Nunchuk_Read() == NUNCHUK_CONNECTED) {
+      #ifdef CONTROL_NUNCHUK
       if (inIdx == CONTROL_NUNCHUK) {
         input1[inIdx].raw = (nunchuk_data[0] - 127) * 8; // X axis 0-255
         input2[inIdx].raw = (nunchuk_data[1] - 128) * 8; // Y axis 0-255
       }
+      #endif
       #ifdef SUPPORT_BUTTONS
         button1 = (uint8_t)nunchuk_data[5] & 1;
         button2 = (uint8_t)(nunchuk_data[5] >> 1) & 1;
@@ -1062,7 +1518,7 @@ void handleTimeout(void) {
       input1[inIdx].cmd  = 0;
       input2[inIdx].cmd  = 0;
     } else {
-      ctrlModReq  = ctrlModReqRaw;                                      // Follow the Mode request
+      ctrlModReq  = (ctrlModReqRaw == POS_MODE) ? SPD_MODE : ctrlModReqRaw; // Follow the Mode request. POS_MODE runs the motors in SPD_MODE
     }
 
     // Beep in case of Input index change
@@ -1154,6 +1610,20 @@ void usart2_rx_check(void)
       }
       usart_process_command(&commandL_raw, &commandL, 2);               // Process data
     }
+    #ifdef POSITION_CONTROL
+    ptr = (uint8_t *)&positionL_raw;                                    // Position target frame, same handling as the command frame
+    if (pos > old_pos && (pos - old_pos) == positionL_len) {
+      memcpy(ptr, &rx_buffer_L[old_pos], positionL_len);
+      usart_process_position(&positionL_raw, 2);
+    } else if ((rx_buffer_L_len - old_pos + pos) == positionL_len) {
+      memcpy(ptr, &rx_buffer_L[old_pos], rx_buffer_L_len - old_pos);
+      if (pos > 0) {
+        ptr += rx_buffer_L_len - old_pos;
+        memcpy(ptr, &rx_buffer_L[0], pos);
+      }
+      usart_process_position(&positionL_raw, 2);
+    }
+    #endif
   }
   #endif // CONTROL_SERIAL_USART2
 
@@ -1227,6 +1697,20 @@ void usart3_rx_check(void)
       }
       usart_process_command(&commandR_raw, &commandR, 3);               // Process data
     }
+    #ifdef POSITION_CONTROL
+    ptr = (uint8_t *)&positionR_raw;                                    // Position target frame, same handling as the command frame
+    if (pos > old_pos && (pos - old_pos) == positionR_len) {
+      memcpy(ptr, &rx_buffer_R[old_pos], positionR_len);
+      usart_process_position(&positionR_raw, 3);
+    } else if ((rx_buffer_R_len - old_pos + pos) == positionR_len) {
+      memcpy(ptr, &rx_buffer_R[old_pos], rx_buffer_R_len - old_pos);
+      if (pos > 0) {
+        ptr += rx_buffer_R_len - old_pos;
+        memcpy(ptr, &rx_buffer_R[0], pos);
+      }
+      usart_process_position(&positionR_raw, 3);
+    }
+    #endif
   }
   #endif // CONTROL_SERIAL_USART3
 
@@ -1321,6 +1805,51 @@ void usart_process_command(SerialCommand *command_in, SerialCommand *command_out
 }
 #endif
 
+/*
+ * Process position target Rx data
+ * - if the position_in data is valid (correct START_FRAME and checksum) set the position targets of both wheels
+ */
+#if (defined(CONTROL_SERIAL_USART2) || defined(CONTROL_SERIAL_USART3)) && defined(POSITION_CONTROL)
+void usart_process_position(SerialPosition *position_in, uint8_t usart_idx)
+{
+  uint16_t checksum;
+  int16_t  spdMax;
+  uint32_t primask;
+  if (position_in->start == SERIAL_POS_START_FRAME) {
+    checksum = (uint16_t)(position_in->start ^ position_in->mode
+                          ^ (uint16_t)position_in->posL ^ (uint16_t)((uint32_t)position_in->posL >> 16)
+                          ^ (uint16_t)position_in->posR ^ (uint16_t)((uint32_t)position_in->posR >> 16)
+                          ^ position_in->spdMax);
+    if (position_in->checksum == checksum && position_in->mode <= 1) {
+      spdMax = (position_in->spdMax == 0) ? POS_SPD_MAX : (int16_t)MIN(position_in->spdMax, 1000);
+      posCtrlLeft.r_spdMax  = spdMax;
+      posCtrlRight.r_spdMax = spdMax;
+      primask = __get_PRIMASK();        // The DMA ISR reads and resets the targets: update both at once
+      __disable_irq();
+      if (position_in->mode == 1) {     // Relative to the current target
+        posCtrlLeft.z_posTgt  += position_in->posL;
+        posCtrlRight.z_posTgt += position_in->posR;
+      } else {                          // Absolute
+        posCtrlLeft.z_posTgt  = position_in->posL;
+        posCtrlRight.z_posTgt = position_in->posR;
+      }
+      __set_PRIMASK(primask);
+      if (usart_idx == 2) {             // USART2
+        #ifdef CONTROL_SERIAL_USART2
+        timeoutFlgSerial_L = 0;         // Clear timeout flag
+        timeoutCntSerial_L = 0;         // Reset timeout counter
+        #endif
+      } else if (usart_idx == 3) {      // USART3
+        #ifdef CONTROL_SERIAL_USART3
+        timeoutFlgSerial_R = 0;         // Clear timeout flag
+        timeoutCntSerial_R = 0;         // Reset timeout counter
+        #endif
+      }
+    }
+  }
+}
+#endif
+
 /*
  * Process Sideboard Rx data
  * - if the Sideboard_in data is valid (correct START_FRAME and checksum) copy the Sideboard_in to Sideboard_out
@@ -1543,7 +2072,7 @@ void saveConfig() {
   #if !defined(VARIANT_HOVERBOARD) && !defined(VARIANT_TRANSPOTTER)
     if (inp_cal_valid || cur_spd_valid) {
       #if defined(DEBUG_SERIAL_USART2) || defined(DEBUG_SERIAL_USART3)
-        printf("Saving configuration to EEprom\r\n");
+        fmtPrint("Saving configuration to EEprom\r\n");
       #endif
 
       HAL_FLASH_Unlock();
@@ -1569,7 +2098,7 @@ void saveConfig() {
 void poweroff(void) {
   // enable = 0;
   // #if defined(DEBUG_SERIAL_USART2) || defined(DEBUG_SERIAL_USART3)
-  // printf("-- Motors disabled --\r\n");
+  // fmtPrint("-- Motors disabled --\r\n");
   // #endif
   // buzzerCount = 0;  // prevent interraction with beep counter
   // buzzerPattern = 0;
@@ -1611,7 +2140,7 @@ void poweroffPressCheck(void) {
         }
       } else if (cnt_press > 8) {                         // Short press: power off (80 ms debounce)
         #if defined(DEBUG_SERIAL_USART2) || defined(DEBUG_SERIAL_USART3)
-          printf("Powering off, button has been pressed\r\n");
+          fmtPrint("Powering off, button has been pressed\r\n");
         #endif
       poweroff();
       }
@@ -1628,13 +2157,7 @@ void poweroffPressCheck(void) {
         HAL_Delay(350);
         poweroff();
       } else {
-        setDistance += 0.25;
-        if (setDistance > 2.6) {
-          setDistance = 0.5;
-        }
-        beepShort(setDistance / 0.25);
-        saveValue = setDistance * 1000;
-        saveValue_valid = 1;
+        setDistanceStep(DIST_STEP);
       }
     }
   #else
@@ -1646,6 +2169,25 @@ void poweroffPressCheck(void) {
   #endif
 }
 
+#ifdef VARIANT_TRANSPOTTER
+ /*
+ * Step the TRANSPOTTER follow distance by dDist [mm], wrapping around inside [DIST_MIN, DIST_MAX]
+ * The new distance is signalled by beeps (one per DIST_STEP) and saved to flash on power-off
+ */
+void setDistanceStep(int16_t dDist) {
+  int16_t dist = (int16_t)setDistance + dDist;
+  if (dist > DIST_MAX) {
+    dist = DIST_MIN;
+  } else if (dist < DIST_MIN) {
+    dist = DIST_MAX;
+  }
+  setDistance     = (uint16_t)dist;
+  beepShort(setDistance / DIST_STEP);
+  saveValue       = setDistance;
+  saveValue_valid = 1;
+}
+#endif
+
 
 
 /* =========================== Filtering Functions =========================== */
@@ -1683,6 +2225,91 @@ void filtLowPass32(int32_t u, uint16_t coef, int32_t *y) {
   // }
 
 
+  /* Biquad filter fixed-point 32 bits: coefficients fixdt(1,32,28), states and output fixdt(1,32,16)
+  * Direct form I with a 64-bit accumulator. The coefficients are designed by biquadDesign() (RBJ cookbook, bilinear transform)
+  * from x->typ, x->f_c and x->q, without floating point, with a DC gain of exactly 1. The bits truncated by the accumulator are
+  * fed back into the next step, so that a constant input is reached exactly. The filter is reset by clearing x->x, x->y and x->e.
+  * 
+  * Inputs:       u     = int16 or int32
+  * Outputs:      y     = fixdt(1,32,16), same format as filtLowPass32
+  * Parameters:   fs    = sample frequency [Hz], f_c < fs / 2
+  * 
+  * Example: 
+  * Low-pass 3.0 Hz, Q = 0.707 in the 200 Hz main loop
+  * Biquad bq = { 0, 30, 181 };
+  * biquadDesign(200, &bq);
+  * filtBiquad32(u, &bq, &y);
+  * yint = (int16_t)(y >> 16); // the integer output is the fixed-point ouput shifted by 16 bits
+  */
+#define BQ_ONE      (1LL << 30)               // 1.0 in fixdt(1,64,30)
+#define BQ_PI       3373259426LL              // pi in fixdt(1,64,30)
+
+static int64_t biquadSin(int64_t w) {         // sin(w), w in [0, pi] in fixdt(1,64,30): Taylor series up to w^11 on [0, pi/2]
+  int64_t w2, t = BQ_ONE;
+
+  if (w > BQ_PI / 2) {
+    w = BQ_PI - w;
+  }
+  w2 = (w * w) >> 30;
+  t  = BQ_ONE - ((w2 * t) >> 30) / 110;
+  t  = BQ_ONE - ((w2 * t) >> 30) / 72;
+  t  = BQ_ONE - ((w2 * t) >> 30) / 42;
+  t  = BQ_ONE - ((w2 * t) >> 30) / 20;
+  t  = BQ_ONE - ((w2 * t) >> 30) / 6;
+  return (w * t) >> 30;
+}
+
+void biquadDesign(uint16_t fs, Biquad *x) {
+  int64_t w0, sn, sh, omc, alpha, a0;
+  int64_t b[3], a[2];
+  uint16_t f_c = MIN(x->f_c, (uint16_t)(fs * 5 - 1));   // stay below the Nyquist frequency
+  uint16_t q   = MAX(x->q, 1);
+
+  w0    = 2 * BQ_PI * f_c / ((int64_t)fs * 10);        // 2*pi*f_c/fs [rad]
+  sn    = biquadSin(w0);
+  sh    = biquadSin(w0 / 2);
+  omc   = (2 * sh * sh) >> 30;                          // 1 - cos(w0) = 2*sin(w0/2)^2, accurate for small w0
+  alpha = (sn << 7) / q;                                // sin(w0) / (2*Q)
+  a0    = BQ_ONE + alpha;
+
+  if (x->typ == 1) {                                    // notch
+    b[0] = BQ_ONE;
+    b[1] = -2 * (BQ_ONE - omc);
+    b[2] = BQ_ONE;
+  } else {                                              // low-pass
+    b[0] = omc / 2;
+    b[1] = omc;
+    b[2] = omc / 2;
+  }
+  a[0] = -2 * (BQ_ONE - omc);
+  a[1] = BQ_ONE - alpha;
+
+  for (uint8_t i = 0; i < 3; i++) {
+    x->b[i] = (int32_t)(b[i] * (1LL << 28) / a0);         // normalize to a0 = 1, convert to fixdt(1,32,28)
+  }
+  for (uint8_t i = 0; i < 2; i++) {
+    x->a[i] = (int32_t)(a[i] * (1LL << 28) / a0);
+  }
+  x->b[1] = (1L << 28) + x->a[0] + x->a[1] - x->b[0] - x->b[2];   // Absorb the rounding in b1: DC gain exactly 1
+}
+
+void filtBiquad32(int32_t u, Biquad *x, int32_t *y) {
+  int64_t tmp;
+  int32_t u16 = (int32_t)CLAMP((int64_t)u * 65536, -2147483648LL, 2147483647LL);
+
+  tmp = (int64_t)x->b[0] * u16 + (int64_t)x->b[1] * x->x[0] + (int64_t)x->b[2] * x->x[1]
+      - (int64_t)x->a[0] * x->y[0] - (int64_t)x->a[1] * x->y[1] + x->e;
+  x->e = (int32_t)(tmp & ((1L << 28) - 1));             // Error feedback: carry the truncated bits into the next step (no deadband)
+  tmp  = CLAMP(tmp >> 28, -2147483648LL, 2147483647LL);  // Overflow protection
+
+  x->x[1] = x->x[0];
+  x->x[0] = u16;
+  x->y[1] = x->y[0];
+  x->y[0] = (int32_t)tmp;
+  *y      = (int32_t)((tmp + 32768) & ~0xFFFFLL);       // Round to an integer, so that (*y >> 16) settles exactly on the input
+}
+
+
   /* rateLimiter16(int16_t u, int16_t rate, int16_t *y);
   * Inputs:       u     = int16
   * Outputs:      y     = fixdt(1,16,4)
@@ -1707,10 +2334,51 @@ void rateLimiter16(int16_t u, int16_t rate, int16_t *y) {
 }
 
 
+  /* sCurveStep(int16_t u, SCurve *x);
+  * Jerk limited (S-curve) target generator. Stepped at a fixed rate of 1 kHz.
+  * The acceleration ramps with jerkMax up to accMax and is ramped down early enough to reach the target without overshoot:
+  * braking starts when a^2 >= 2 * jerkMax * |u - y|.
+  * Inputs:       u     = int16 [-velMax, velMax]
+  * Outputs:      y     = int16 (x->y in fixdt(1,32,16))
+  * Parameters:   velMax = [0, 1000]; accMax = [-/s] (0, 32767]; jerkMax = [-/s^2] (0, 32767]
+  */
+int16_t sCurveStep(int16_t u, SCurve *x) {
+  int32_t e;
+  int32_t eAbs;
+  int32_t jerkStep;
+  int64_t a;
+  int8_t  dir;
+
+  u         = CLAMP(u, -x->velMax, x->velMax);
+  e         = ((int32_t)u << 16) - x->y;
+  eAbs      = ABS(e);
+  jerkStep  = ((int32_t)x->jerkMax << 16) / 1000;         // acceleration change per step in fixdt(1,32,16)
+  dir       = (e > 0) ? 1 : -1;
+
+  if (eAbs <= jerkStep / 1000 + 1 && ABS(x->a) <= jerkStep) { // target reached
+    x->y = (int32_t)u << 16;
+    x->a = 0;
+    return u;
+  }
+
+  a = x->a;
+  if (a * dir > 0 && a * a >= (int64_t)2 * x->jerkMax * eAbs * 65536) {
+    a -= dir * jerkStep;                                  // ramp down the acceleration
+  } else {
+    a += dir * jerkStep;                                  // ramp up the acceleration
+  }
+  x->a  = (int32_t)CLAMP(a, -((int32_t)x->accMax << 16), (int32_t)x->accMax << 16);
+  x->y += x->a / 1000;
+
+  return (int16_t)(x->y >> 16);
+}
+
+
   /* mixerFcn(rtu_speed, rtu_steer, &rty_speedR, &rty_speedL); 
   * Inputs:       rtu_speed, rtu_steer                  = fixdt(1,16,4)
   * Outputs:      rty_speedR, rty_speedL                = int16_t
   * Parameters:   SPEED_COEFFICIENT, STEER_COEFFICIENT  = fixdt(0,16,14)
+  *               steerSched (STEER_SCHED_ENABLE)       = steering factor over speedAvgAbs, fixdt(0,16,14)
   */
 void mixerFcn(int16_t rtu_speed, int16_t rtu_steer, int16_t *rty_speedR, int16_t *rty_speedL) {
     int16_t prodSpeed;
@@ -1719,6 +2387,9 @@ void mixerFcn(int16_t rtu_speed, int16_t rtu_steer, int16_t *rty_speedR, int16_t
 
     prodSpeed   = (int16_t)((rtu_speed * (int16_t)SPEED_COEFFICIENT) >> 14);
     prodSteer   = (int16_t)((rtu_steer * (int16_t)STEER_COEFFICIENT) >> 14);
+    #ifdef STEER_SCHED_ENABLE
+    prodSteer   = (int16_t)((prodSteer * (int32_t)steerSchedCalc(speedAvgAbs, &steerSched)) >> 14);  // factor <= 1.0, no overflow
+    #endif
 
     tmp         = prodSpeed - prodSteer;  
     tmp         = CLAMP(tmp, -32768, 32767);  // Overflow protection
@@ -1795,3 +2466,816 @@ void multipleTapDet(int16_t u, uint32_t timeNow, MultipleTap *x) {
 }
 
 
+
+/* ======================= Gain Schedule Functions ======================== */
+
+  /* gainSchedCalc(int16_t n, const GainSched *gs, uint16_t *kp, uint16_t *ki)
+  * This function linearly interpolates the gains between the speed breakpoints. Outside the breakpoints the first or last gains are used.
+  * Inputs:       n = int16_t (measured speed [rpm], the sign is ignored)
+  * Outputs:      kp, ki = uint16_t
+  */
+void gainSchedCalc(int16_t n, const GainSched *gs, uint16_t *kp, uint16_t *ki) {
+  int32_t nAbs = ABS((int32_t)n);
+  int32_t dn;
+  uint8_t i;
+
+  if (nAbs <= gs->n[0]) {
+    *kp = gs->kp[0];
+    *ki = gs->ki[0];
+    return;
+  }
+
+  for (i = 0; i < 2; i++) {
+    if (nAbs < gs->n[i+1]) {
+      dn  = gs->n[i+1] - gs->n[i];
+      *kp = (uint16_t)(gs->kp[i] + ((int32_t)gs->kp[i+1] - gs->kp[i]) * (nAbs - gs->n[i]) / dn);
+      *ki = (uint16_t)(gs->ki[i] + ((int32_t)gs->ki[i+1] - gs->ki[i]) * (nAbs - gs->n[i]) / dn);
+      return;
+    }
+  }
+
+  *kp = gs->kp[2];
+  *ki = gs->ki[2];
+}
+
+  /* steerSchedCalc(int16_t n, const SteerSched *ss)
+  * This function linearly interpolates the steering factor between the speed breakpoints. Outside the breakpoints the first or last factor is used.
+  * Inputs:       n = int16_t (average speed [rpm], the sign is ignored)
+  * Outputs:      steering factor = uint16_t, fixdt(0,16,14)
+  */
+uint16_t steerSchedCalc(int16_t n, const SteerSched *ss) {
+  int32_t nAbs = ABS((int32_t)n);
+  uint8_t i;
+
+  if (nAbs <= ss->n[0]) {
+    return ss->r[0];
+  }
+
+  for (i = 0; i < 2; i++) {
+    if (nAbs < ss->n[i+1]) {
+      return (uint16_t)(ss->r[i] + ((int32_t)ss->r[i+1] - ss->r[i]) * (nAbs - ss->n[i]) / (ss->n[i+1] - ss->n[i]));
+    }
+  }
+
+  return ss->r[2];
+}
+
+
+
+/* ======================= Hall Calibration Function ======================= */
+
+  /* hallCalibCalc(const int32_t *sumCos, const int32_t *sumSin, HallCalib *x)
+  * This function evaluates a hall calibration sweep. For each raw hall state the sums of the r_cos_M1_Table/r_sin_M1_Table entries
+  * of all visited angles point to its center. The center gives the hall sector (60 deg each, same convention as vec_hallToPos),
+  * its deviation from the sector center gives the angle offset.
+  * Inputs:       sumCos, sumSin = int32_t[8] (indexed by the raw hall state hallA << 2 | hallB << 1 | hallC)
+  * Outputs:      x->z_map, x->a_offset; return 0: failed (state not seen or sector used twice), 1: normal hall order, 2: reversed hall order
+  */
+uint8_t hallCalibCalc(const int32_t *sumCos, const int32_t *sumSin, HallCalib *x) {
+  int64_t   dot, dotMax;
+  int32_t   a_offsetSum = 0;
+  uint8_t   z_rawBySector[6] = {0};
+  uint8_t   z_hall, z_sector, i, iMax;
+  int8_t    z_dir;
+
+  for (z_hall = 1; z_hall < 7; z_hall++) {
+    if (sumCos[z_hall] == 0 && sumSin[z_hall] == 0) {
+      return 0;                                         // hall state not seen
+    }
+
+    iMax   = 0;                                         // search the table angle closest to the center
+    dotMax = 0;
+    for (i = 0; i < 180; i++) {
+      dot = (int64_t)sumCos[z_hall] * rtConstP.r_cos_M1_Table[i] + (int64_t)sumSin[z_hall] * rtConstP.r_sin_M1_Table[i];
+      if (i == 0 || dot > dotMax) {
+        dotMax = dot;
+        iMax   = i;
+      }
+    }
+
+    z_sector = iMax / 30;                               // 30 table steps = 60 deg
+    if (z_rawBySector[z_sector]) {
+      return 0;                                         // two hall states in the same sector
+    }
+    z_rawBySector[z_sector] = z_hall;
+    a_offsetSum += (iMax - z_sector * 30) * 2 - 30;     // deviation from the sector center [deg]
+  }
+
+  x->z_map[0] = 0;
+  x->z_map[7] = 7;
+  for (z_sector = 0; z_sector < 6; z_sector++) {        // map each raw state to the hall state the controller expects for its sector
+    for (z_hall = 1; z_hall < 7; z_hall++) {
+      if (rtConstP.vec_hallToPos_Value[z_hall] == z_sector) {
+        x->z_map[z_rawBySector[z_sector]] = z_hall;
+      }
+    }
+  }
+  x->a_offset = (int16_t)(a_offsetSum * 16 / 6);        // mean offset in fixdt(1,16,4)
+
+  // Hall order of the raw states compared to the stock mapping
+  z_dir = (int8_t)(rtConstP.vec_hallToPos_Value[z_rawBySector[1]] - rtConstP.vec_hallToPos_Value[z_rawBySector[0]]);
+  return (z_dir == 1 || z_dir == -5) ? 1 : 2;
+}
+
+
+
+/* ====================== Wheel Synchronisation Function ====================== */
+
+  /* syncCtrlStep(int16_t tgtL, int16_t tgtR, int16_t nL, int16_t nR, int16_t n_max, uint8_t b_ena, SyncCtrl *x)
+  * This function implements a cross-coupled synchronisation of two wheels. The measured speeds are projected on the direction
+  * orthogonal to the targets (tgtL, tgtR): this is the sync error, which is zero whenever nL / nR = tgtL / tgtR.
+  * A PI controller on the sync error corrects both targets. It has no effect on the common speed, that is left to the speed loops.
+  * Call it at a fixed 1 kHz rate.
+  * Inputs:       tgtL, tgtR = int16_t (targets [-1000, 1000]); nL, nR = int16_t (measured speeds [rpm]);
+  *               n_max = int16_t (speed of target 1000, fixdt(1,16,4)); b_ena = uint8_t
+  * Outputs:      x->r_corrL, x->r_corrR (add them to the targets)
+  */
+void syncCtrlStep(int16_t tgtL, int16_t tgtR, int16_t nL, int16_t nR, int16_t n_max, uint8_t b_ena, SyncCtrl *x) {
+  int32_t nTgtL, nTgtR;
+  int32_t norm2;
+  int64_t err;
+  int32_t eL, eR;
+  int32_t intMax = (int32_t)x->r_corrMax << 16;
+
+  if (!b_ena || n_max <= 0 || ABS(tgtL) + ABS(tgtR) < SYNC_TGT_MIN) {
+    x->z_intL   = x->z_intR   = 0;
+    x->r_corrL  = x->r_corrR  = 0;
+    return;
+  }
+
+  nTgtL = (int32_t)nL * 16000 / n_max;                  // rpm to target units: 1000 = n_max
+  nTgtR = (int32_t)nR * 16000 / n_max;
+
+  // Sync error split on both wheels: projection on (tgtR, -tgtL)
+  norm2 = (int32_t)tgtL * tgtL + (int32_t)tgtR * tgtR;
+  err   = (int64_t)nTgtL * tgtR - (int64_t)nTgtR * tgtL;
+  eL    = (int32_t)( err * tgtR / norm2);
+  eR    = (int32_t)(-err * tgtL / norm2);
+
+  // PI controller, the integrators are limited to the correction limit
+  x->z_intL   = CLAMP(x->z_intL - eL * x->ki, -intMax, intMax);
+  x->z_intR   = CLAMP(x->z_intR - eR * x->ki, -intMax, intMax);
+  x->r_corrL  = (int16_t)CLAMP((x->z_intL >> 16) - ((eL * x->kp) >> 8), -x->r_corrMax, x->r_corrMax);
+  x->r_corrR  = (int16_t)CLAMP((x->z_intR >> 16) - ((eR * x->kp) >> 8), -x->r_corrMax, x->r_corrMax);
+}
+
+/* ======================== Traction Control Function ======================== */
+
+  /* tractionCtrlStep(int16_t tgt, int16_t n, int16_t nOther, uint8_t b_ena, TractionCtrl *x)
+  * This function detects wheel slip and reduces the torque target. Slip is a wheel acceleration in the torque direction above the
+  * plausible acceleration for the target, or a speed above the other wheel plus dn_max. The speeds are compared in absolute value,
+  * hence the mounting direction of the motors does not matter. Call it at a fixed 1 kHz rate.
+  * Inputs:       tgt = int16_t (torque target [-1000, 1000]); n, nOther = int16_t (speed of this and of the other wheel [rpm]); b_ena = uint8_t
+  * Outputs:      limited torque target; x->b_slip, x->r_fac
+  */
+int16_t tractionCtrlStep(int16_t tgt, int16_t n, int16_t nOther, uint8_t b_ena, TractionCtrl *x) {
+  int16_t acc;
+  int32_t accLim;
+  int8_t  dir;
+
+  filtLowPass32(CLAMP((n - x->n_prev) * 1000, -32000, 32000), TRC_FILT, &x->z_acc);   // [rpm/s] at 1 kHz
+  x->n_prev = n;
+
+  if (!b_ena) {
+    x->r_fac  = 32768;
+    x->b_slip = 0;
+    return tgt;
+  }
+
+  acc     = (int16_t)(x->z_acc >> 16);
+  dir     = (tgt > 0) - (tgt < 0);
+  accLim  = (int32_t)x->a_max * MAX(ABS(tgt), 100) / 1000;
+  x->b_slip = dir != 0 && ((int32_t)acc * dir > accLim || (n * dir > 0 && ABS(n) - ABS(nOther) > x->dn_max));
+
+  if (x->b_slip) {
+    x->r_fac = (x->r_fac > x->r_dec) ? x->r_fac - x->r_dec : 0;
+  } else {
+    x->r_fac = (uint16_t)MIN(x->r_fac + x->r_inc, 32768);
+  }
+
+  return (int16_t)(((int32_t)tgt * x->r_fac) >> 15);
+}
+
+/* ======================== Anti-Lock Brake Function ======================== */
+
+  /* absBrakeStep(int16_t tgt, int16_t n, int16_t nOther, int16_t n_max, uint8_t z_ctrlMod, uint8_t b_ena, AbsBrake *x)
+  * This function detects a locking wheel while braking and reduces the braking part of the target (see dcLimApply).
+  * Braking is decided on the vehicle speed (average of both wheels), not on the own wheel speed, which is wrong or zero when the
+  * wheel locks. A wheel is locking when its deceleration is above a_max or when it is slower than the other wheel by more than dn_max.
+  * Call it at a fixed 1 kHz rate.
+  * Inputs:       tgt = int16_t (target [-1000, 1000]); n = int16_t (speed of this wheel [rpm]);
+  *               nOther = int16_t (speed of the other wheel in the rotation direction of this wheel [rpm]);
+  *               n_max = int16_t (fixdt(1,16,4)); z_ctrlMod = uint8_t; b_ena = uint8_t
+  * Outputs:      limited target; x->b_lock, x->r_fac
+  */
+int16_t absBrakeStep(int16_t tgt, int16_t n, int16_t nOther, int16_t n_max, uint8_t z_ctrlMod, uint8_t b_ena, AbsBrake *x) {
+  int16_t nVeh;
+  uint8_t b_brake;
+
+  filtLowPass32(CLAMP((ABS(x->n_prev) - ABS(n)) * 1000, -32000, 32000), ABS_FILT, &x->z_dec);   // [rpm/s] at 1 kHz
+  x->n_prev = n;
+
+  if (!b_ena || MAX(ABS(n), ABS(nOther)) < x->n_min) {
+    x->r_fac  = 32768;
+    x->b_lock = 0;
+    return tgt;
+  }
+
+  nVeh = (int16_t)((n + nOther) / 2);                   // vehicle speed seen from this wheel
+  if (z_ctrlMod == TRQ_MODE) {
+    b_brake = (int32_t)tgt * nVeh < 0;                  // torque opposite to the motion
+  } else {
+    b_brake = ((int32_t)tgt * n_max / 16000 - nVeh) * nVeh < 0;   // speed target below the vehicle speed
+  }
+  x->b_lock = b_brake && ((x->z_dec >> 16) > x->a_max || ABS(nOther) - ABS(n) > x->dn_max);
+
+  if (x->b_lock) {
+    x->r_fac = (x->r_fac > x->r_dec) ? x->r_fac - x->r_dec : 0;
+  } else {
+    x->r_fac = (uint16_t)MIN(x->r_fac + x->r_inc, 32768);
+  }
+
+  return dcLimApply(tgt, nVeh, n_max, z_ctrlMod, x->r_fac, 1);
+}
+
+/* ======================= DC Current Limit Functions ======================= */
+
+  /* regenLimStep(int16_t iDC, int16_t uBat, RegenLim *x)
+  * This function updates the regen factor. The current part integrates the current error (about 1% per 1 ms and A),
+  * the voltage part is a linear foldback. Call it at a fixed 1 kHz rate.
+  * Inputs:       iDC = int16_t (DC link current of both motors averaged over the step, positive = into the battery);
+  *               uBat = int16_t (battery voltage, batVoltage scaling)
+  * Outputs:      x->i_regen, x->r_fac
+  */
+void regenLimStep(int16_t iDC, int16_t uBat, RegenLim *x) {
+  int32_t r_facI;
+  int32_t r_facU;
+
+  x->i_regen  = iDC;
+  r_facI      = x->r_facI + (int32_t)(x->i_max - x->i_regen) * 6;       // 1 A = A2BIT_CONV = 50 bits -> 300 / 32768 ~ 1%
+  x->r_facI   = (uint16_t)CLAMP(r_facI, 0, 32768);
+
+  if (uBat <= x->u_start) {
+    r_facU = 32768;
+  } else if (uBat >= x->u_stop) {
+    r_facU = 0;
+  } else {
+    r_facU = (int32_t)(x->u_stop - uBat) * 32768 / (x->u_stop - x->u_start);
+  }
+
+  x->r_fac  = (uint16_t)MIN(x->r_facI, r_facU);
+}
+
+  /* batLimStep(int16_t iDC, BatLim *x)
+  * This function updates the battery (discharge) current limit and factor. Above i_cont a peak budget of
+  * (i_peak - i_cont) * t_peak is used up, which lowers the limit linearly from i_peak to i_cont. Below i_cont the budget recovers.
+  * The factor integrates the error to the limit (about 1% per 1 ms and A). Call it at a fixed 1 kHz rate.
+  * Inputs:       iDC = int16_t (DC link current of both motors averaged over the step, positive = into the battery)
+  * Outputs:      x->i_bat, x->i_lim, x->r_fac
+  */
+void batLimStep(int16_t iDC, BatLim *x) {
+  int32_t z_budgetMax;
+  int32_t r_fac;
+
+  x->i_bat      = -iDC;
+  z_budgetMax   = (int32_t)MAX(x->i_peak - x->i_cont, 0) * x->t_peak;
+  x->z_budget   = CLAMP(x->z_budget + x->i_bat - x->i_cont, 0, z_budgetMax);
+  if (z_budgetMax > 0) {
+    x->i_lim    = (int16_t)(x->i_peak - (int64_t)(x->i_peak - x->i_cont) * x->z_budget / z_budgetMax);
+  } else {
+    x->i_lim    = x->i_cont;
+  }
+
+  r_fac         = x->r_fac + (int32_t)(x->i_lim - x->i_bat) * 6;
+  x->r_fac      = (uint16_t)CLAMP(r_fac, 0, 32768);
+}
+
+  /* dcLimApply(int16_t tgt, int16_t n, int16_t n_max, uint8_t z_ctrlMod, uint16_t r_fac, uint8_t b_regen)
+  * This function reduces the braking (b_regen = 1) or the driving (b_regen = 0) part of a wheel target by a limit factor.
+  * TRQ_MODE: the target is scaled. SPD_MODE: the target is moved towards the measured speed, which limits the torque of the
+  * speed loop. Other modes are not changed.
+  * Inputs:       tgt = int16_t (target [-1000, 1000]); n = int16_t (measured speed [rpm]);
+  *               n_max = int16_t (speed of target 1000, fixdt(1,16,4)); z_ctrlMod = uint8_t; r_fac = uint16_t (fixdt(0,16,15))
+  * Outputs:      limited target
+  */
+int16_t dcLimApply(int16_t tgt, int16_t n, int16_t n_max, uint8_t z_ctrlMod, uint16_t r_fac, uint8_t b_regen) {
+  int32_t nTgt;
+  int32_t dTgt;
+  uint8_t b_brake;
+
+  if (r_fac >= 32768) {
+    return tgt;
+  }
+
+  if (z_ctrlMod == TRQ_MODE) {
+    b_brake = (int32_t)tgt * n < 0;                     // torque opposite to the rotation
+    if (b_brake == b_regen) {
+      tgt = (int16_t)(((int32_t)tgt * r_fac) >> 15);
+    }
+  } else if (z_ctrlMod == SPD_MODE && n_max > 0) {
+    nTgt    = (int32_t)n * 16000 / n_max;               // rpm to target units: 1000 = n_max
+    dTgt    = tgt - nTgt;
+    b_brake = dTgt * nTgt < 0;                          // decelerating
+    if (b_brake == b_regen && dTgt != 0) {
+      tgt = (int16_t)CLAMP(nTgt + ((dTgt * r_fac) >> 15), -1000, 1000);
+    }
+  }
+
+  return tgt;
+}
+
+
+
+/* ====================== Bumpless Transfer Functions ====================== */
+
+  /* bumplessOpTgt(uint8_t z_ctrlMod, uint8_t z_ctrlTyp, int16_t n, int16_t iq, int16_t u, int16_t n_max, int16_t i_max, int16_t u_max)
+  * This function returns the input target which corresponds to the present operating point in a control mode and type.
+  * COM_CTRL and SIN_CTRL: voltage, 1000 = 16000. FOC_CTRL: VLT_MODE 1000 = u_max, SPD_MODE 1000 = n_max, TRQ_MODE 1000 = i_max.
+  * Inputs:       z_ctrlMod, z_ctrlTyp = uint8_t; n = int16_t (measured speed [rpm]); iq = int16_t (measured q-current, fixdt(1,16,4));
+  *               u = int16_t (last applied voltage, fixdt(1,16,4)); n_max, i_max, u_max = int16_t (fixdt(1,16,4))
+  * Outputs:      target [-1000, 1000]
+  */
+int16_t bumplessOpTgt(uint8_t z_ctrlMod, uint8_t z_ctrlTyp, int16_t n, int16_t iq, int16_t u, int16_t n_max, int16_t i_max, int16_t u_max) {
+  int32_t tgt;
+
+  if (z_ctrlTyp != FOC_CTRL) {
+    tgt = u >> 4;
+  } else if (z_ctrlMod == SPD_MODE) {
+    tgt = (int32_t)n * 16000 / MAX(n_max, 1);
+  } else if (z_ctrlMod == TRQ_MODE) {
+    tgt = (int32_t)iq * 1000 / MAX(i_max, 1);
+  } else {
+    tgt = (int32_t)u * 1000 / MAX(u_max, 1);
+  }
+
+  return (int16_t)CLAMP(tgt, -1000, 1000);
+}
+
+  /* bumplessStep(int16_t tgt, int16_t tgtOp, uint8_t z_ctrlMod, uint8_t z_ctrlTyp, uint8_t b_ena, Bumpless *x)
+  * This function detects a change of the control mode or type. At a change the target is offset to the operating point tgtOp,
+  * afterwards the offset decreases linearly to 0 within t_decay steps. Changes from or to OPEN_MODE are not transferred.
+  * Inputs:       tgt = int16_t (target [-1000, 1000]); tgtOp = int16_t (operating point in the new mode, see bumplessOpTgt());
+  *               z_ctrlMod, z_ctrlTyp = uint8_t; b_ena = uint8_t (motors enabled)
+  * Outputs:      target with the offset
+  */
+int16_t bumplessStep(int16_t tgt, int16_t tgtOp, uint8_t z_ctrlMod, uint8_t z_ctrlTyp, uint8_t b_ena, Bumpless *x) {
+  if (!b_ena) {
+    x->z_offset   = 0;
+  } else if ((z_ctrlMod != x->z_ctrlMod || z_ctrlTyp != x->z_ctrlTyp) && z_ctrlMod != OPEN_MODE && x->z_ctrlMod != OPEN_MODE) {
+    x->z_offset   = (int32_t)(tgtOp - tgt) << 16;
+    x->dz_offset  = x->z_offset / MAX(x->t_decay, 1);
+  }
+  x->z_ctrlMod    = z_ctrlMod;
+  x->z_ctrlTyp    = z_ctrlTyp;
+
+  if (ABS(x->z_offset) <= ABS(x->dz_offset)) {
+    x->z_offset   = 0;
+  } else {
+    x->z_offset  -= x->dz_offset;
+  }
+
+  return (int16_t)CLAMP(tgt + (x->z_offset >> 16), -1000, 1000);
+}
+
+
+
+/* ======================= Limit Derating Functions ======================= */
+
+  /* limDerate(int16_t x, int16_t x_min, uint16_t r_fac, uint16_t r_scale, LimDerate *d)
+  * This function derates a limit: the nominal value is interpolated towards x_min by r_fac and scaled by r_scale,
+  * the lower of both is used. If x differs from the value written last, it was changed elsewhere and becomes the new nominal value.
+  * Inputs:       x = int16_t (actual limit); x_min = int16_t (limit at r_fac = 0);
+  *               r_fac, r_scale = uint16_t (fixdt(0,16,15), 32768 = no derating)
+  * Outputs:      derated limit, to be written back to x
+  */
+int16_t limDerate(int16_t x, int16_t x_min, uint16_t r_fac, uint16_t r_scale, LimDerate *d) {
+  int16_t x_scale;
+
+  if (x != d->x_set) {
+    d->x_nom  = x;
+  }
+  x_min       = MIN(x_min, d->x_nom);
+  x_scale     = (int16_t)(((int32_t)d->x_nom * r_scale) >> 15);
+  d->x_set    = (int16_t)(x_min + (((int32_t)(d->x_nom - x_min) * r_fac) >> 15));
+  d->x_set    = MIN(d->x_set, x_scale);
+  return d->x_set;
+}
+
+  /* motThermStep(int16_t iq, int16_t id, MotTherm *x)
+  * This function accumulates the squared phase current and updates the first order thermal model once per second:
+  * heat += (i^2 / i_cont^2 - heat) / t_tau, T_wind = T_amb + (T_max - T_amb) * heat.
+  * The derating factor goes linearly from 1 at T_start to 0 at T_max.
+  * Inputs:       iq, id = int16_t (measured phase currents in fixdt(1,16,4))
+  * Outputs:      x->T_wind, x->r_fac
+  */
+void motThermStep(int16_t iq, int16_t id, MotTherm *x) {
+  int32_t i_cont;
+  int32_t p_heat;
+  int32_t T_wind;
+
+  iq            = iq >> 4;                                // fixdt(1,16,4) to ADC bits
+  id            = id >> 4;
+  x->z_i2Sum   += (uint32_t)((int32_t)iq * iq + (int32_t)id * id);
+  if (++x->z_cnt < x->n_steps) {
+    return;
+  }
+
+  i_cont        = MAX(x->i_cont >> 4, 1);
+  p_heat        = (int32_t)MIN(((int64_t)x->z_i2Sum << 20) / ((int64_t)i_cont * i_cont * x->z_cnt), (int64_t)1000 << 20);
+  x->z_heat    += (p_heat - x->z_heat) / MAX(x->t_tau, 1);
+  x->z_i2Sum    = 0;
+  x->z_cnt      = 0;
+
+  T_wind        = x->T_amb + (int32_t)(((int64_t)(x->T_max - x->T_amb) * x->z_heat) >> 20);
+  x->T_wind     = (int16_t)MIN(T_wind, 32767);
+  if (x->T_wind <= x->T_start) {
+    x->r_fac    = 32768;
+  } else if (x->T_wind >= x->T_max) {
+    x->r_fac    = 0;
+  } else {
+    x->r_fac    = (uint16_t)((int32_t)(x->T_max - x->T_wind) * 32768 / (x->T_max - x->T_start));
+  }
+}
+
+
+
+/* ===================== Ripple Compensation Functions ===================== */
+
+  /* rippleCompCalc(int16_t a_elecAngle, const RippleComp *x)
+  * This function returns the compensation at the electrical angle, linearly interpolated between the table points.
+  * Point i is located at i * 360 / RIPPLE_COMP_BINS deg.
+  * Inputs:       a_elecAngle = int16_t (electrical angle [0, 359] deg)
+  * Outputs:      compensation [torque target, 1000 = i_max]
+  */
+int16_t rippleCompCalc(int16_t a_elecAngle, const RippleComp *x) {
+  int32_t z_pos;
+  int16_t z_frac;
+  uint8_t i;
+
+  z_pos   = (int32_t)CLAMP(a_elecAngle, 0, 359) * RIPPLE_COMP_BINS;
+  i       = (uint8_t)(z_pos / 360);
+  z_frac  = (int16_t)(z_pos % 360);
+
+  return (int16_t)(x->r_comp[i] + ((x->r_comp[(i + 1) % RIPPLE_COMP_BINS] - x->r_comp[i]) * z_frac) / 360);
+}
+
+  /* rippleLearnStep(int16_t a_elecAngle, int16_t iq, RippleComp *x)
+  * This function accumulates the measured iq on the nearest table point. Call it at constant speed.
+  * Inputs:       a_elecAngle = int16_t (electrical angle [0, 359] deg); iq = int16_t (measured q-current, same scaling as i_max)
+  * Outputs:      x->z_iqSum, x->z_iqCnt
+  */
+void rippleLearnStep(int16_t a_elecAngle, int16_t iq, RippleComp *x) {
+  uint8_t i;
+
+  i = (uint8_t)((((int32_t)CLAMP(a_elecAngle, 0, 359) * RIPPLE_COMP_BINS + 180) / 360) % RIPPLE_COMP_BINS);
+  if (x->z_iqCnt[i] < 0xFFFF) {
+    x->z_iqSum[i] += iq;
+    x->z_iqCnt[i]++;
+  }
+}
+
+  /* rippleLearnCalc(int16_t i_max, RippleComp *x)
+  * This function converts the accumulated iq into the compensation table: the mean iq per point minus the mean over all
+  * points (friction and load are not compensated), scaled to the torque target and saturated to the int8 table.
+  * Inputs:       i_max = int16_t (maximum current, fixdt(1,16,4))
+  * Outputs:      x->r_comp; return 1 if all points had samples, 0 otherwise (x->r_comp unchanged)
+  */
+uint8_t rippleLearnCalc(int16_t i_max, RippleComp *x) {
+  int32_t iq_mean[RIPPLE_COMP_BINS];
+  int32_t iq_meanAll = 0;
+  uint8_t i;
+
+  for (i = 0; i < RIPPLE_COMP_BINS; i++) {
+    if (x->z_iqCnt[i] == 0 || i_max <= 0) {
+      return 0;
+    }
+    iq_mean[i]  = x->z_iqSum[i] / x->z_iqCnt[i];
+    iq_meanAll += iq_mean[i];
+  }
+  iq_meanAll /= RIPPLE_COMP_BINS;
+
+  for (i = 0; i < RIPPLE_COMP_BINS; i++) {
+    x->r_comp[i] = (int8_t)CLAMP((iq_mean[i] - iq_meanAll) * 1000 / i_max, -127, 127);
+  }
+  return 1;
+}
+
+
+
+/* =========================== Encoder Function =========================== */
+
+  /* encoderAngleCalc(uint16_t cnt, uint8_t hallA, uint8_t hallB, uint8_t hallC, uint8_t polePairs, EncoderAngle *x)
+  * This function converts the encoder counter to the mechanical angle and aligns it on the hall transitions.
+  * On a hall transition the electrical angle is known: it is the boundary between the two hall sectors (same convention as the
+  * hall angle estimation of the BLDC controller). The first transition sets the counter offset, the next ones are only checked
+  * against ENCODER_ALIGN_TOL. After 3 failed checks the encoder is not used anymore (e.g. wrong ENCODER_CPR or direction).
+  * Inputs:       cnt = uint16_t (encoder timer counter [0, ENCODER_CPR-1]); hallA, hallB, hallC = uint8_t; polePairs = uint8_t
+  * Outputs:      a_mechAngle in fixdt(1,16,4) [deg]; x->b_aligned (use it for b_angleMeasEna)
+  */
+int16_t encoderAngleCalc(uint16_t cnt, uint8_t hallA, uint8_t hallB, uint8_t hallC, uint8_t polePairs, EncoderAngle *x) {
+  uint8_t   z_hall;
+  int8_t    z_hallPos;
+  int8_t    z_dir;
+  int16_t   a_edge;
+  int16_t   a_err;
+  uint32_t  z_cnt;
+
+  z_hall = (uint8_t)((hallA << 2) + (hallB << 1) + hallC);
+  if (z_hall != 0 && z_hall != 7) {                     // skip invalid hall states
+    z_hallPos = rtConstP.vec_hallToPos_Value[z_hall];
+    if (x->z_hallPosPrev >= 0 && z_hallPos != x->z_hallPosPrev && x->z_alignErrCnt < 3) {
+      z_dir = z_hallPos - x->z_hallPosPrev;
+      if (z_dir == 1 || z_dir == -5) {                  // forward:  lower boundary of the new sector
+        a_edge = z_hallPos * 960;                       // 960 = 60 deg in fixdt(1,16,4)
+      } else if (z_dir == -1 || z_dir == 5) {           // backward: upper boundary of the new sector
+        a_edge = x->z_hallPosPrev * 960;
+      } else {                                          // a sector was skipped, the transition is not reliable
+        a_edge = -1;
+      }
+
+      if (a_edge >= 0) {
+        a_edge  = (a_edge + 480 + x->a_hallOffset + 5760) % 5760;  // the measured angle path of the controller subtracts 30 deg
+        z_cnt   = (cnt + x->z_cntOffset) % ENCODER_CPR;
+        a_err   = a_edge - (int16_t)(((z_cnt * polePairs) % ENCODER_CPR) * 5760 / ENCODER_CPR);
+        if (a_err < 0) {
+          a_err += 5760;                                // wrap to [0, 360) deg
+        }
+
+        if (!x->b_aligned) {                            // align: shift the counter by the electrical angle error
+          x->z_cntOffset  = (uint16_t)((x->z_cntOffset + (uint32_t)a_err * ENCODER_CPR / (5760U * polePairs)) % ENCODER_CPR);
+          x->b_aligned    = 1;
+        } else if (a_err > ENCODER_ALIGN_TOL && a_err < 5760 - ENCODER_ALIGN_TOL) {
+          x->b_aligned    = 0;                          // fall back to the hall estimation, align again on the next transition
+          x->z_alignErrCnt++;
+        }
+      }
+    }
+    x->z_hallPosPrev = z_hallPos;
+  }
+
+  z_cnt = (cnt + x->z_cntOffset) % ENCODER_CPR;
+  return (int16_t)(z_cnt * 5760 / ENCODER_CPR);         // 5760 = 360 deg in fixdt(1,16,4)
+}
+
+
+
+/* ======================= Position Control Functions ======================= */
+
+  /* posCountHall(uint8_t hallA, uint8_t hallB, uint8_t hallC, PosCtrl *x)
+  * This function counts the hall sector transitions into the 32-bit position: +1 forward, -1 backward (same direction as n_mot)
+  * Inputs:       hallA, hallB, hallC = uint8_t
+  * Outputs:      x->z_pos [counts]
+  */
+void posCountHall(uint8_t hallA, uint8_t hallB, uint8_t hallC, PosCtrl *x) {
+  uint8_t z_hall;
+  int8_t  z_hallPos;
+  int8_t  z_dir;
+
+  z_hall = (uint8_t)((hallA << 2) + (hallB << 1) + hallC);
+  if (z_hall == 0 || z_hall == 7) {                     // skip invalid hall states
+    return;
+  }
+
+  z_hallPos = rtConstP.vec_hallToPos_Value[z_hall];
+  if (x->z_cntPrev >= 0) {
+    z_dir = (int8_t)(z_hallPos - x->z_cntPrev);
+    if (z_dir == 1 || z_dir == -5) {
+      x->z_pos++;
+    } else if (z_dir == -1 || z_dir == 5) {
+      x->z_pos--;
+    }
+  }
+  x->z_cntPrev = z_hallPos;
+}
+
+  /* posCountEnc(uint16_t cnt, PosCtrl *x)
+  * This function accumulates the encoder counter difference into the 32-bit position. The counter wraps at ENCODER_CPR,
+  * hence it has to be called at least twice per half revolution.
+  * Inputs:       cnt = uint16_t (encoder timer counter [0, ENCODER_CPR-1])
+  * Outputs:      x->z_pos [counts]
+  */
+void posCountEnc(uint16_t cnt, PosCtrl *x) {
+  int32_t z_inc;
+
+  if (x->z_cntPrev >= 0) {
+    z_inc = (int32_t)cnt - x->z_cntPrev;
+    if (z_inc > ENCODER_CPR / 2) {                      // counter wrap-around
+      z_inc -= ENCODER_CPR;
+    } else if (z_inc < -(ENCODER_CPR / 2)) {
+      z_inc += ENCODER_CPR;
+    }
+    x->z_pos += z_inc;
+  }
+  x->z_cntPrev = cnt;
+}
+
+  /* posCtrlStep(uint16_t kp, uint8_t b_ena, PosCtrl *x)
+  * This function calculates the speed command from the position error: P controller with deadband and speed limitation.
+  * When not enabled, the target follows the measured position, so that enabling does not cause a jump.
+  * Inputs:       kp = fixdt(0,16,8) [speed command / count]; b_ena = uint8_t
+  * Outputs:      x->r_spdCmd [-x->r_spdMax, x->r_spdMax]; x->b_reached
+  */
+void posCtrlStep(uint16_t kp, uint8_t b_ena, PosCtrl *x) {
+  int64_t z_err;
+  int64_t r_tmp;
+
+  if (!b_ena) {
+    x->z_posTgt   = x->z_pos;
+    x->r_spdCmd   = 0;
+    x->b_reached  = 1;
+    return;
+  }
+
+  z_err = (int64_t)x->z_posTgt - x->z_pos;                 // int64: no overflow over the full int32 target range
+  if (ABS(z_err) <= POS_DBAND) {
+    x->r_spdCmd   = 0;
+    x->b_reached  = 1;
+  } else {
+    r_tmp         = (z_err * kp) >> 8;
+    x->r_spdCmd   = (int16_t)CLAMP(r_tmp, -x->r_spdMax, x->r_spdMax);
+    x->b_reached  = 0;
+  }
+}
+
+/* ======================= Balance Control Functions ======================= */
+
+  /* balanceStep(int16_t pitch, int16_t dPitch, int16_t n, int16_t n_tgt, uint8_t b_ena, BalanceCtrl *x)
+  * This function balances one wheel: speed loop (PI) -> pitch setpoint, pitch loop (P) -> pitch rate setpoint,
+  * pitch rate loop (P) -> torque target. It engages when b_ena is set and the pitch is below x->pitchStart and fades in within x->t_soft.
+  * It cuts off when b_ena is cleared or the pitch exceeds x->pitchMax. Called every DELAY_IN_MAIN_LOOP.
+  * Inputs:       pitch = [deg*100], positive = tilted forward; dPitch = pitch rate [gyro LSB]; n, n_tgt = wheel speed and target [rpm];
+  *               b_ena = uint8_t
+  * Outputs:      x->r_trq [-1000, 1000], positive = forward; x->b_acv
+  */
+void balanceStep(int16_t pitch, int16_t dPitch, int16_t n, int16_t n_tgt, uint8_t b_ena, BalanceCtrl *x) {
+  int32_t z_err, pitchSp, rateSp;
+  int64_t r_trq;
+  uint16_t dr_soft;
+
+  if (!b_ena || ABS(pitch) > x->pitchMax) {             // disabled or tilt-out
+    x->b_acv  = 0;
+  } else if (!x->b_acv && ABS(pitch) < x->pitchStart) { // engage only when level
+    x->b_acv  = 1;
+    x->z_intN = 0;
+    x->r_soft = 0;
+  }
+  if (!x->b_acv) {
+    x->r_trq  = 0;
+    return;
+  }
+
+  // Speed loop: a faster speed target tilts the pitch setpoint forward
+  z_err     = n_tgt - n;
+  x->z_intN = x->z_intN + (int32_t)(((int64_t)z_err * x->kiN * DELAY_IN_MAIN_LOOP * 256) / 1000);
+  x->z_intN = CLAMP(x->z_intN, -((int32_t)x->pitchSpMax << 16), (int32_t)x->pitchSpMax << 16);
+  pitchSp   = CLAMP((x->z_intN >> 16) + ((z_err * x->kpN) >> 8), -x->pitchSpMax, x->pitchSpMax);
+
+  // Pitch and pitch rate loops: tilted forward -> drive forward
+  rateSp    = ((pitchSp - pitch) * x->kpP) >> 8;
+  r_trq     = ((int64_t)(dPitch - rateSp) * x->kpR) >> 8;
+  r_trq     = CLAMP(r_trq, -1000, 1000);
+
+  // Soft start
+  dr_soft   = (uint16_t)((32768 * DELAY_IN_MAIN_LOOP) / MAX(x->t_soft, DELAY_IN_MAIN_LOOP));
+  x->r_soft = (uint16_t)MIN(x->r_soft + dr_soft, 32768);
+  x->r_trq  = (int16_t)((r_trq * x->r_soft) >> 15);
+}
+
+/* ======================= Cruise Control Functions ======================= */
+
+  /* cruisePIStep(int16_t cmd, int16_t n, uint8_t b_spdMode, int16_t n_max, CruisePI *x)
+  * This function regulates the vehicle speed n to x->n_tgt while x->b_ena is set. Called every DELAY_IN_MAIN_LOOP.
+  * The output is the command in the active mode: PI output in VOLTAGE and TORQUE mode, the speed target in SPEED mode.
+  * An input beyond the cruise command in the driving direction overrides it (acceleration) and holds the integrator.
+  * When x->b_ena is cleared, the output fades to the input within x->t_release. A braking input takes over at once.
+  * Inputs:       cmd = [-1000, 1000]; n = vehicle speed [rpm]; b_spdMode = uint8_t; n_max = fixdt(1,16,4)
+  * Outputs:      x->r_out [-1000, 1000]
+  */
+int16_t cruisePIStep(int16_t cmd, int16_t n, uint8_t b_spdMode, int16_t n_max, CruisePI *x) {
+  int32_t z_err, r_pi;
+  int8_t  z_dir;
+  uint16_t dr_fade;
+
+  z_dir = (x->n_tgt < 0) ? -1 : 1;
+  if (x->b_ena) {
+    z_err = x->n_tgt - n;
+    if (b_spdMode) {
+      r_pi      = CLAMP((int32_t)x->n_tgt * 16000 / MAX(n_max, 1), -1000, 1000);
+      x->z_int  = r_pi * 65536;                         // ready for a change to VOLTAGE or TORQUE mode
+    } else {
+      r_pi      = CLAMP((x->z_int >> 16) + ((z_err * x->kp) >> 8), -1000, 1000);
+      if ((cmd - r_pi) * z_dir <= 0) {                  // integrate only while the input does not override
+        x->z_int += (int32_t)(((int64_t)z_err * x->ki * DELAY_IN_MAIN_LOOP * 256) / 1000);
+        x->z_int  = CLAMP(x->z_int, -1000L * 65536, 1000L * 65536);
+      }
+    }
+    x->r_cruise = (int16_t)r_pi;
+    x->r_fade   = 32768;
+    x->r_out    = ((cmd - r_pi) * z_dir > 0) ? cmd : (int16_t)r_pi;
+  } else if (x->r_fade > 0 && cmd * z_dir >= 0) {       // fade back to the input, unless braking
+    dr_fade     = (uint16_t)((32768 * DELAY_IN_MAIN_LOOP) / MAX(x->t_release, DELAY_IN_MAIN_LOOP));
+    x->r_fade   = (x->r_fade > dr_fade) ? x->r_fade - dr_fade : 0;
+    x->r_out    = (int16_t)(cmd + (((int32_t)(x->r_cruise - cmd) * x->r_fade) >> 15));
+  } else {
+    x->r_fade   = 0;
+    x->r_out    = cmd;
+  }
+
+  return x->r_out;
+}
+
+/* ======================= Torque Map Functions ======================= */
+
+  /* torqueMapStep(int16_t cmd, int16_t n, TorqueMap *x)
+  * This function scales a driving command (same sign as the speed) by the torque factor linearly interpolated between the
+  * speed breakpoints. Braking commands are passed through. While x->b_launch is set, the rise of the driving command is limited
+  * to x->dr_launch per step; the launch ends above x->n_launchEnd and is armed again at standstill. Called every DELAY_IN_MAIN_LOOP.
+  * Inputs:       cmd = [-1000, 1000]; n = vehicle speed [rpm]
+  * Outputs:      command [-1000, 1000]
+  */
+int16_t torqueMapStep(int16_t cmd, int16_t n, TorqueMap *x) {
+  int32_t nAbs = ABS((int32_t)n);
+  int32_t r_fac, r_cmd;
+  uint8_t i;
+
+  if (nAbs < 10) {                                      // standstill: arm the launch control
+    x->b_launch = (x->dr_launch > 0);
+  } else if (nAbs > x->n_launchEnd) {
+    x->b_launch = 0;
+  }
+
+  if ((int32_t)cmd * n < 0) {                           // braking: no scaling, no rate limit
+    x->z_cmd = 0;
+    return cmd;
+  }
+
+  // Torque factor in fixdt(0,16,8) [%]
+  r_fac = x->r[3] * 256;
+  if (nAbs <= x->n[0]) {
+    r_fac = x->r[0] * 256;
+  } else {
+    for (i = 0; i < 3; i++) {
+      if (nAbs < x->n[i+1]) {
+        r_fac = x->r[i] * 256 + ((int32_t)x->r[i+1] - x->r[i]) * (nAbs - x->n[i]) * 256 / (x->n[i+1] - x->n[i]);
+        break;
+      }
+    }
+  }
+  r_cmd = (int32_t)cmd * r_fac * 16 / 25600;            // fixdt(1,16,4)
+
+  // Launch control: limit the rise of the command magnitude only
+  if (x->b_launch && ABS(r_cmd) > ABS(x->z_cmd)) {
+    if ((r_cmd ^ x->z_cmd) < 0) {                       // direction change: restart from 0
+      x->z_cmd = 0;
+    }
+    x->z_cmd = (int16_t)((r_cmd > 0) ? MIN(x->z_cmd + x->dr_launch, r_cmd) : MAX(x->z_cmd - x->dr_launch, r_cmd));
+  } else {
+    x->z_cmd = (int16_t)r_cmd;
+  }
+
+  return x->z_cmd >> 4;
+}
+
+/* ========================== Hill Hold Functions ========================== */
+
+  /* hillHoldStep(int32_t pos, int16_t n, int16_t i_max, uint8_t b_req, HillHold *x)
+  * This function holds the wheel at the position latched when b_req rises: P on the position error and D on the measured speed,
+  * output as torque target. The hold current is limited to x->i_peak and lowered linearly to x->i_cont as the I2t budget
+  * (i_peak^2 - i_cont^2) * t_peak is used up. When b_req falls, the hold torque fades out within x->t_release. Called at 1 kHz.
+  * Inputs:       pos [counts]; n = n_mot [rpm]; i_max = fixdt(1,16,4); b_req = uint8_t
+  * Outputs:      x->r_trq [-1000, 1000] (1000 = i_max)
+  */
+void hillHoldStep(int32_t pos, int16_t n, int16_t i_max, uint8_t b_req, HillHold *x) {
+  int32_t i_peak, i_cont, i_lim, r_lim, r_trq;
+  int64_t z_i2tMax, r_tmp;
+  uint16_t dr_fade;
+
+  i_peak    = x->i_peak >> 4;
+  i_cont    = x->i_cont >> 4;
+  z_i2tMax  = (int64_t)(i_peak * i_peak - i_cont * i_cont) * x->t_peak;
+
+  if (b_req && (!x->b_acv || x->r_fade < 32768)) {     // latch the position, also when requested again during the fade-out
+    x->z_posHold  = pos;
+    x->r_fade     = 32768;
+    x->b_acv      = 1;
+  } else if (!b_req && x->b_acv) {                      // fade out the hold torque
+    dr_fade       = (uint16_t)(32768 / MAX(x->t_release, 1));
+    x->r_fade     = (x->r_fade > dr_fade) ? x->r_fade - dr_fade : 0;
+    x->b_acv      = (x->r_fade > 0);
+  }
+
+  r_trq = 0;
+  if (x->b_acv && i_max > 0) {
+    i_lim   = i_peak - (int32_t)(((int64_t)(i_peak - i_cont) * x->z_i2t) / MAX(z_i2tMax, 1));
+    r_lim   = MIN((i_lim << 4) * 1000 / i_max, 1000);
+    r_tmp   = ((int64_t)(x->z_posHold - pos) * x->kp - (int32_t)n * x->kd) >> 8;
+    r_tmp   = CLAMP(r_tmp, -r_lim, r_lim);
+    r_trq   = (int32_t)((r_tmp * x->r_fade) >> 15);
+  }
+  x->r_trq  = (int16_t)r_trq;
+
+  // I2t budget: used above i_cont, recovered below
+  i_lim     = (int32_t)(((int64_t)ABS(r_trq) * i_max / 1000) >> 4);
+  x->z_i2t += (int64_t)i_lim * i_lim - (int64_t)i_cont * i_cont;
+  x->z_i2t  = CLAMP(x->z_i2t, 0, z_i2tMax);
+}